@@ -0,0 +1,58 @@
+#include "checksum.h"
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* reflected polynomial 0x1EDC6F41 */
+#define CRC32C_POLY 0x82F63B78
+
+static uint32_t crc32c_table[256];
+
+void
+checksum_init(void)
+{
+  for(uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for(unsigned int k = 0; k < 8; k++)
+      crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+    crc32c_table[i] = crc;
+  }
+}
+
+static uint32_t
+crc32c_scalar(uint32_t crc, const unsigned char *p, size_t len)
+{
+  for(size_t i = 0; i < len; i++)
+    crc = crc32c_table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(__x86_64__)
+/* 8 bytes per crc32 instruction */
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_sse42(uint32_t crc, const unsigned char *p, size_t len)
+{
+  uint64_t c = crc;
+
+  for(; len >= 8; p += 8, len -= 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    c = _mm_crc32_u64(c, v);
+  }
+  for(; len > 0; p++, len--)
+    c = _mm_crc32_u8(c, *p);
+  return c;
+}
+#endif
+
+uint32_t
+checksum_crc32c(uint32_t crc, const void *data, size_t len)
+{
+  crc = ~crc;
+#if defined(__x86_64__)
+  if(__builtin_cpu_supports("sse4.2"))
+    return ~crc32c_sse42(crc, data, len);
+#endif
+  return ~crc32c_scalar(crc, data, len);
+}
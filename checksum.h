@@ -0,0 +1,16 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * CRC32C (Castagnoli) of len bytes, continuing from crc, 0 to start.
+ * Uses the SSE4.2 crc32 instruction where available and a table
+ * otherwise, both give the same result.
+ */
+uint32_t checksum_crc32c(uint32_t crc, const void *data, size_t len);
+/* set up the table of the fallback, before the first checksum_crc32c() */
+void checksum_init(void);
+
+#endif
@@ -0,0 +1,80 @@
+#include "clock_sync.h"
+#include "timer.h"
+#include <math.h>
+
+struct clock_model clock_model;
+
+static void
+clock_model_add(struct clock_model *m, uint64_t local, int64_t offset)
+{
+  if(m->n == 0) {
+    m->base = local;
+    m->offset0 = offset;
+  }
+  double x = (double) (local - m->base), y = (double) (offset - m->offset0);
+
+  m->n++;
+  m->sx += x;
+  m->sy += y;
+  m->sxx += x * x;
+  m->sxy += x * y;
+  double det = m->n * m->sxx - m->sx * m->sx;
+  if(m->n < 2 || det <= 0) {
+    m->a = m->sy / m->n;
+    m->b = 0;
+  } else {
+    m->b = (m->n * m->sxy - m->sx * m->sy) / det;
+    m->a = (m->sy - m->b * m->sx) / m->n;
+  }
+}
+
+void
+clock_sync(MPI_Comm comm)
+{
+  int rank, size;
+  uint64_t ref, best_rtt = UINT64_MAX, best_mid = 0;
+  int64_t best_offset = 0;
+
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  /* rank 0 answers the pings of one rank after the other */
+  for(int peer = 1; peer < size; peer++) {
+    if(rank == 0) {
+      for(unsigned int i = 0; i < CLOCK_SYNC_ROUNDS; i++) {
+        MPI_Recv(NULL, 0, MPI_BYTE, peer, CLOCK_SYNC_TAG, comm, MPI_STATUS_IGNORE);
+        ref = timer_ns(timer_read());
+        MPI_Send(&ref, 1, MPI_UINT64_T, peer, CLOCK_SYNC_TAG, comm);
+      }
+    } else if(rank == peer) {
+      for(unsigned int i = 0; i < CLOCK_SYNC_ROUNDS; i++) {
+        uint64_t t0 = timer_ns(timer_read());
+        MPI_Send(NULL, 0, MPI_BYTE, 0, CLOCK_SYNC_TAG, comm);
+        MPI_Recv(&ref, 1, MPI_UINT64_T, 0, CLOCK_SYNC_TAG, comm, MPI_STATUS_IGNORE);
+        uint64_t t1 = timer_ns(timer_read());
+        if(t1 - t0 < best_rtt) {
+          best_rtt = t1 - t0;
+          best_mid = t0 + best_rtt / 2;
+          best_offset = (int64_t) (best_mid - ref);
+        }
+      }
+    }
+  }
+  if(rank == 0) {
+    best_rtt = 0;
+    best_mid = timer_ns(timer_read());
+  }
+  clock_model.rtt = best_rtt;
+  clock_model_add(&clock_model, best_mid, best_offset);
+}
+
+uint64_t
+clock_global(uint64_t local)
+{
+  const struct clock_model *m = &clock_model;
+
+  if(m->n == 0)
+    return local;
+  double x = (double) (int64_t) (local - m->base);
+  return local - m->offset0 - llround(m->a + m->b * x);
+}
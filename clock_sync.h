@@ -0,0 +1,39 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+#include <mpi.h>
+
+/*
+ * Common timeline for all ranks. clock_sync() estimates the offset of the
+ * local timer to the one of rank 0 with a ping-pong, keeping the round
+ * with the smallest round trip time, whose midpoint is closest to the
+ * reply of rank 0. Every call adds one point to a linear regression of
+ * the offset over the local time, so the drift between the clocks is
+ * followed if it is called periodically.
+ */
+#define CLOCK_SYNC_ROUNDS 32
+#define CLOCK_SYNC_TAG 424243
+
+struct clock_model {
+  /* first local time and offset, the regression runs relative to them */
+  uint64_t base;
+  int64_t offset0;
+  /* offset = offset0 + a + b * (local - base) */
+  double a;
+  double b;
+  /* least squares sums */
+  unsigned int n;
+  double sx, sy, sxx, sxy;
+  /* round trip time of the last sync */
+  uint64_t rtt;
+};
+
+extern struct clock_model clock_model;
+
+/* collective over comm, rank 0 of comm is the reference */
+void clock_sync(MPI_Comm comm);
+/* local ns, see timer_ns(), on the timeline of the reference */
+uint64_t clock_global(uint64_t local);
+
+#endif
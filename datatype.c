@@ -0,0 +1,203 @@
+#include "datatype.h"
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "mpi_tests.h"
+
+int
+dt_msg_init(struct dt_msg *m, size_t msg_size, unsigned int stride,
+	    enum dt_layout layout, unsigned prefault)
+{
+  size_t count = msg_size / sizeof(int);
+
+  m->layout = layout;
+  m->type = MPI_DATATYPE_NULL;
+  m->stride = stride;
+  m->strided = NULL;
+  m->packed = NULL;
+  /* the payload is whole ints, so the bytes sent are msg_size */
+  if(count == 0 || msg_size % sizeof(int) != 0)
+    return -1;
+  if(count > INT_MAX || (size_t) stride * count / stride != count)
+    return -1;
+  /* the displacements and the array size of these are ints */
+  if((layout == dt_indexed || layout == dt_subarray) && (size_t) stride * count > INT_MAX)
+    return -1;
+  m->count = count;
+  m->packed = calloc(count, sizeof(int));
+  m->strided = calloc(count * stride, sizeof(int));
+  if(m->packed == NULL || m->strided == NULL) {
+    dt_msg_free(m);
+    return -1;
+  }
+  /* calloc() may hand out untouched zero pages, fault them in like msg_buf_init() */
+  if(prefault) {
+    memset(m->packed, 0, count * sizeof(int));
+    memset(m->strided, 0, count * stride * sizeof(int));
+  }
+
+  switch(layout) {
+    case dt_vector:
+      MPI_Type_vector(count, 1, stride, MPI_INT, &m->type);
+      break;
+    case dt_indexed: {
+      int *lens = malloc(2 * count * sizeof(int)), *displs = lens + count;
+      if(lens == NULL) {
+        dt_msg_free(m);
+        return -1;
+      }
+      for(size_t i = 0; i < count; i++) {
+        lens[i] = 1;
+        displs[i] = i * stride;
+      }
+      MPI_Type_indexed(count, lens, displs, MPI_INT, &m->type);
+      free(lens);
+      break;
+    }
+    case dt_subarray: {
+      int sizes[2] = { count, stride }, subsizes[2] = { count, 1 }, starts[2] = { 0, 0 };
+      MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_INT, &m->type);
+      break;
+    }
+    default:
+      break;
+  }
+  if(m->type != MPI_DATATYPE_NULL)
+    MPI_Type_commit(&m->type);
+  return 0;
+}
+
+void
+dt_msg_free(struct dt_msg *m)
+{
+  if(m->type != MPI_DATATYPE_NULL)
+    MPI_Type_free(&m->type);
+  free(m->strided);
+  free(m->packed);
+  m->strided = NULL;
+  m->packed = NULL;
+}
+
+#if defined(__x86_64__)
+/* the indices are relative to the block, so they stay small for any count */
+__attribute__((target("avx2"))) static size_t
+dt_gather_avx2(int *packed, const int *strided, size_t count, unsigned int stride)
+{
+  const __m256i vindex = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+      _mm256_set1_epi32(stride));
+  size_t i;
+
+  for(i = 0; i + 8 <= count; i += 8) {
+    __m256i v = _mm256_i32gather_epi32(&strided[i * stride], vindex, sizeof(int));
+    _mm256_storeu_si256((__m256i *) &packed[i], v);
+  }
+  return i;
+}
+
+__attribute__((target("avx512f"))) static size_t
+dt_gather_avx512(int *packed, const int *strided, size_t count, unsigned int stride)
+{
+  const __m512i vindex = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+      8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(stride));
+  size_t i;
+
+  for(i = 0; i + 16 <= count; i += 16) {
+    __m512i v = _mm512_i32gather_epi32(vindex, &strided[i * stride], sizeof(int));
+    _mm512_storeu_si512(&packed[i], v);
+  }
+  return i;
+}
+
+__attribute__((target("avx512f"))) static size_t
+dt_scatter_avx512(int *strided, const int *packed, size_t count, unsigned int stride)
+{
+  const __m512i vindex = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+      8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(stride));
+  size_t i;
+
+  for(i = 0; i + 16 <= count; i += 16) {
+    __m512i v = _mm512_loadu_si512(&packed[i]);
+    _mm512_i32scatter_epi32(&strided[i * stride], vindex, v, sizeof(int));
+  }
+  return i;
+}
+#endif
+
+void
+dt_gather(int *packed, const int *strided, size_t count, unsigned int stride)
+{
+  size_t done = 0;
+
+  /* 16 lanes times the stride have to fit into the 32 bit indices */
+#if defined(__x86_64__)
+  if(stride > 1 && stride <= INT_MAX / 16) {
+    if(__builtin_cpu_supports("avx512f"))
+      done = dt_gather_avx512(packed, strided, count, stride);
+    else if(__builtin_cpu_supports("avx2"))
+      done = dt_gather_avx2(packed, strided, count, stride);
+  }
+#endif
+  for(size_t i = done; i < count; i++)
+    packed[i] = strided[i * stride];
+}
+
+void
+dt_scatter(int *strided, const int *packed, size_t count, unsigned int stride)
+{
+  size_t done = 0;
+
+  /* AVX2 has no scatter */
+#if defined(__x86_64__)
+  if(stride > 1 && stride <= INT_MAX / 16 && __builtin_cpu_supports("avx512f"))
+    done = dt_scatter_avx512(strided, packed, count, stride);
+#endif
+  for(size_t i = done; i < count; i++)
+    strided[i * stride] = packed[i];
+}
+
+void
+datatype_func(struct dt_msg *m, uint64_t *snd_time, uint64_t *rcv_time,
+	      uint64_t *pack_time, int tag)
+{
+  /* the derived types describe the strided buffer, the others the packed one */
+  int *data = m->type != MPI_DATATYPE_NULL ? m->strided : m->packed;
+  int count = m->type != MPI_DATATYPE_NULL ? 1 : m->count;
+  MPI_Datatype type = m->type != MPI_DATATYPE_NULL ? m->type : MPI_INT;
+  int msg_id = MAGIC_ID;
+  uint64_t time_start, time_end;
+
+  assert(world_size % 2 == 0);
+  if(world_rank % 2 != 0) {
+    time_start = timer_read();
+    MPI_Recv(data, count, type, world_rank - 1, msg_id, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
+    if(m->layout == dt_manual) {
+      time_start = timer_read();
+      dt_scatter(m->strided, m->packed, m->count, m->stride);
+      time_end = timer_read();
+      *pack_time = leg_done(leg_prb, time_start, time_end);
+    }
+  } else {
+    /* contig sends the packed buffer as it is */
+    int *payload = m->layout == dt_contig ? m->packed : m->strided;
+    payload[0] = tag;
+    if(m->layout == dt_manual) {
+      time_start = timer_read();
+      dt_gather(m->packed, m->strided, m->count, m->stride);
+      time_end = timer_read();
+      *pack_time = leg_done(leg_prb, time_start, time_end);
+    }
+
+    time_start = timer_read();
+    MPI_Send(data, count, type, world_rank + 1, msg_id, MPI_COMM_WORLD);
+    time_end = timer_read();
+    *snd_time = leg_done(leg_snd, time_start, time_end);
+  }
+}
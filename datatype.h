@@ -0,0 +1,57 @@
+#ifndef DATATYPE_H
+#define DATATYPE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mpi.h>
+
+/*
+ * The same payload of msg_size / sizeof(int) ints, which lives every
+ * stride-th int of a strided buffer like the face of a stencil, sent as
+ *
+ *   contig    MPI_INT from a contiguous buffer, the baseline
+ *   vector    MPI_Type_vector() on the strided buffer
+ *   indexed   MPI_Type_indexed() on the strided buffer
+ *   subarray  MPI_Type_create_subarray(), a column of a count x stride array
+ *   manual    packed with dt_gather(), sent as MPI_INT, unpacked with
+ *             dt_scatter()
+ *
+ * The derived types let MPI pack and unpack on both sides.
+ */
+enum dt_layout {
+  dt_contig,
+  dt_vector,
+  dt_indexed,
+  dt_subarray,
+  dt_manual,
+};
+
+struct dt_msg {
+  enum dt_layout layout;
+  MPI_Datatype type;
+  int count;
+  unsigned int stride;
+  /* count * stride ints */
+  int *strided;
+  /* count ints */
+  int *packed;
+};
+
+/* prefault touches the buffers right away, like msg_buf_init() */
+int dt_msg_init(struct dt_msg *m, size_t msg_size, unsigned int stride,
+    enum dt_layout layout, unsigned prefault);
+void dt_msg_free(struct dt_msg *m);
+
+/* packed[i] = strided[i * stride] and back, vectorized where possible */
+void dt_gather(int *packed, const int *strided, size_t count, unsigned int stride);
+void dt_scatter(int *strided, const int *packed, size_t count, unsigned int stride);
+
+/*
+ * The even rank sends the payload to its odd partner, the send is the
+ * snd and the receive the rcv leg. The manual packing on the even and
+ * the unpacking on the odd rank is the prb leg.
+ */
+void datatype_func(struct dt_msg *m, uint64_t *snd_time, uint64_t *rcv_time,
+    uint64_t *pack_time, int tag);
+
+#endif
@@ -1,165 +1,579 @@
 #include "mpi_tests.h"
+#include "checksum.h"
 #include <mpi.h>
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
-#include "tlog/timespec.h"
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+struct leg_stamps leg_stamps;
+struct msg_verify msg_verify;
+
+/* page aligned allocation of whole pages, optionally touched right away */
+static void *
+page_alloc(size_t size, unsigned prefault, size_t *alloc_size)
+{
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  void *data;
+
+  /* round up to full pages, so no other allocation shares them */
+  *alloc_size = (size + page_size - 1) & ~(page_size - 1);
+  if(*alloc_size == 0)
+    *alloc_size = page_size;
+
+  if(posix_memalign(&data, page_size, *alloc_size) != 0)
+    return NULL;
+  /* touch every page now, so that the first iterations don't pay for the faults */
+  if(prefault)
+    memset(data, 0, *alloc_size);
+
+  return data;
+}
+
+int
+msg_buf_init(struct msg_buf *buf,
+	     const size_t msg_size,
+	     unsigned prefault,
+	     unsigned fresh)
+{
+  buf->msg_size = msg_size;
+  buf->fresh = fresh;
+  buf->prefault = prefault;
+  buf->data = NULL;
+  buf->alloc_size = 0;
+  buf->rdata = NULL;
+  buf->rdata_size = 0;
+  buf->reqs = NULL;
+  buf->nr_reqs = 0;
+  buf->psnd = NULL;
+  buf->prcv = NULL;
+  buf->nr_preqs = 0;
+  if(fresh)
+    return 0;
+
+  buf->data = page_alloc(msg_size, prefault, &buf->alloc_size);
+  return buf->data == NULL ? -1 : 0;
+}
+
+void
+msg_buf_free(struct msg_buf *buf)
+{
+  free(buf->data);
+  buf->data = NULL;
+  free(buf->rdata);
+  buf->rdata = NULL;
+  buf->rdata_size = 0;
+  free(buf->reqs);
+  buf->reqs = NULL;
+  buf->nr_reqs = 0;
+  for(unsigned int i = 0; i < buf->nr_preqs; i++) {
+    MPI_Request_free(&buf->psnd[i]);
+    MPI_Request_free(&buf->prcv[i]);
+  }
+  free(buf->psnd);
+  buf->psnd = NULL;
+  buf->prcv = NULL;
+  buf->nr_preqs = 0;
+}
+
+/* request array with room for at least nr_reqs requests, kept across calls */
+MPI_Request *
+msg_buf_reqs(struct msg_buf *buf, unsigned int nr_reqs)
+{
+  if(nr_reqs > buf->nr_reqs) {
+    MPI_Request *reqs = realloc(buf->reqs, nr_reqs * sizeof(MPI_Request));
+    if(reqs == NULL) {
+      fprintf(stderr, "Could not allocate %u requests on rank %i\n",
+          nr_reqs, world_rank);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    buf->reqs = reqs;
+    buf->nr_reqs = nr_reqs;
+  }
+  return buf->reqs;
+}
+
+/*
+ * Persistent send of the message buffer to dest and receive into it from
+ * source, either may be MPI_PROC_NULL. They are set up once and started
+ * by the persistent kernels in every iteration, so the buffer has to stay
+ * the same, which rules out fresh buffers.
+ */
+int
+msg_buf_persist(struct msg_buf *buf, int dest, int source, int tag)
+{
+  unsigned int nr_reqs = msg_nr_requests(buf->msg_size);
+  int ret;
+
+  assert(!buf->fresh && buf->psnd == NULL);
+  buf->psnd = malloc(2 * nr_reqs * sizeof(MPI_Request));
+  if(buf->psnd == NULL)
+    return -1;
+  buf->prcv = buf->psnd + nr_reqs;
+  ret = msg_send_init(buf->data, buf->msg_size, dest, tag, MPI_COMM_WORLD, buf->psnd);
+  if(ret == MPI_SUCCESS)
+    ret = msg_recv_init(buf->data, buf->msg_size, source, tag, MPI_COMM_WORLD, buf->prcv);
+  if(ret != MPI_SUCCESS) {
+    free(buf->psnd);
+    buf->psnd = buf->prcv = NULL;
+    return -1;
+  }
+  buf->nr_preqs = nr_reqs;
+  return 0;
+}
+
+void *
+msg_buf_get(struct msg_buf *buf)
+{
+  if(buf->fresh)
+    return calloc(buf->msg_size ? buf->msg_size : 1, 1);
+  return buf->data;
+}
+
+/*
+ * Separate receive buffer of at least size bytes for kernels which send
+ * and receive at the same time, allocated on first use and kept for the
+ * following iterations. Hand it back with msg_buf_put().
+ */
+void *
+msg_buf_get_recv(struct msg_buf *buf, size_t size)
+{
+  if(buf->fresh)
+    return calloc(size ? size : 1, 1);
+  if(buf->rdata == NULL || size > buf->rdata_size) {
+    free(buf->rdata);
+    buf->rdata = page_alloc(size, buf->prefault, &buf->rdata_size);
+    if(buf->rdata == NULL) {
+      fprintf(stderr, "Could not allocate receive buffer of size %zu on rank %i\n",
+          size, world_rank);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+  }
+  return buf->rdata;
+}
 
 void
-round_trip_func(const unsigned int msg_size,
-		struct timespec *snd_time,
-		struct timespec *rcv_time,
+msg_buf_put(struct msg_buf *buf, void *data)
+{
+  if(buf->fresh)
+    free(data);
+}
+
+/* CRC32C of the payload between the checksum field and MAGIC_END */
+static inline uint32_t
+msg_crc(const void *data, const size_t msg_size)
+{
+  return checksum_crc32c(0, (const char *) data + MSG_HEADER_SIZE,
+      msg_size - MSG_VERIFY_SIZE);
+}
+
+static inline void
+msg_crc_write(void *data, const size_t msg_size)
+{
+  uint32_t crc;
+
+  if(msg_size < MSG_VERIFY_SIZE)
+    return;
+  crc = msg_crc(data, msg_size);
+  memcpy((char *) data + MSG_HEADER_SIZE - sizeof(int), &crc, sizeof(crc));
+}
+
+/*
+ * Put MAGIC_START and the tag at the start and MAGIC_END at the end of
+ * the message, followed by the checksum with --verify. Messages too small
+ * for the whole header get only the fields which fit.
+ */
+void
+msg_header_write(void *data, const size_t msg_size, int tag)
+{
+  const int start = MAGIC_START, end = MAGIC_END;
+  char *bytes = data;
+
+  if(msg_size >= sizeof(int))
+    memcpy(bytes, &start, sizeof(int));
+  if(msg_size >= 2 * sizeof(int))
+    memcpy(bytes + sizeof(int), &tag, sizeof(int));
+  if(msg_size >= MSG_HEADER_SIZE)
+    memcpy(bytes + msg_size - sizeof(int), &end, sizeof(int));
+  if(msg_verify.enabled)
+    msg_crc_write(data, msg_size);
+}
+
+/* fill everything between header and trailer with rand() */
+void
+msg_fill_random(void *data, const size_t msg_size)
+{
+  char *bytes = data;
+
+  if(msg_size <= MSG_HEADER_SIZE)
+    return;
+  for(size_t i = 2 * sizeof(int); i < msg_size - sizeof(int); i++) {
+    bytes[i] = rand();
+  }
+  if(msg_verify.enabled)
+    msg_crc_write(data, msg_size);
+}
+
+/*
+ * Check the fields msg_header_write() put into a received message, tag is
+ * the one the sender used. Counts a failure in msg_verify and reports the
+ * first one of a rank, returns -1 if something doesn't match.
+ */
+int
+msg_check(const void *data, const size_t msg_size, int tag)
+{
+  const char *bytes = data;
+  const char *what = NULL;
+  int start = MAGIC_START, msg_tag = tag, end = MAGIC_END;
+  uint32_t crc;
+
+  if(msg_size >= sizeof(int))
+    memcpy(&start, bytes, sizeof(int));
+  if(msg_size >= 2 * sizeof(int))
+    memcpy(&msg_tag, bytes + sizeof(int), sizeof(int));
+  if(msg_size >= MSG_HEADER_SIZE)
+    memcpy(&end, bytes + msg_size - sizeof(int), sizeof(int));
+
+  if(start != MAGIC_START) {
+    what = "MAGIC_START";
+  } else if(msg_tag != tag) {
+    what = "tag";
+  } else if(end != MAGIC_END) {
+    what = "MAGIC_END";
+  } else if(msg_size >= MSG_VERIFY_SIZE) {
+    memcpy(&crc, bytes + MSG_HEADER_SIZE - sizeof(int), sizeof(crc));
+    if(crc != msg_crc(data, msg_size))
+      what = "checksum";
+  }
+  if(what == NULL)
+    return 0;
+
+  if(msg_verify.failures++ == 0)
+    fprintf(stderr, "Message %i of size %zu failed the %s check on rank %i\n",
+        tag, msg_size, what, world_rank);
+  return -1;
+}
+
+/* size of the first (probe-able) message MPI sees for msg_size bytes */
+size_t
+msg_chunk_size(const size_t msg_size)
+{
+#if MSG_LARGE_COUNT
+  return msg_size;
+#else
+  return msg_size < MSG_CHUNK_SIZE ? msg_size : MSG_CHUNK_SIZE;
+#endif
+}
+
+/*
+ * Send msg_size bytes. Sizes beyond INT_MAX use the MPI-4 large count
+ * interface where available and fall back to a sequence of
+ * MSG_CHUNK_SIZE messages with the same tag otherwise, which msg_recv()
+ * splits up in exactly the same way.
+ */
+int
+msg_send(const void *data, const size_t msg_size, int dest, int tag, MPI_Comm comm)
+{
+#if MSG_LARGE_COUNT
+  return MPI_Send_c(data, (MPI_Count) msg_size, MPI_BYTE, dest, tag, comm);
+#else
+  const char *bytes = data;
+  size_t left = msg_size;
+  int ret;
+
+  while(left > MSG_CHUNK_SIZE) {
+    ret = MPI_Send(bytes, MSG_CHUNK_SIZE, MPI_BYTE, dest, tag, comm);
+    if(ret != MPI_SUCCESS)
+      return ret;
+    bytes += MSG_CHUNK_SIZE;
+    left -= MSG_CHUNK_SIZE;
+  }
+  return MPI_Send(bytes, (int) left, MPI_BYTE, dest, tag, comm);
+#endif
+}
+
+int
+msg_recv(void *data, const size_t msg_size, int source, int tag, MPI_Comm comm)
+{
+#if MSG_LARGE_COUNT
+  return MPI_Recv_c(data, (MPI_Count) msg_size, MPI_BYTE, source, tag, comm,
+      MPI_STATUS_IGNORE);
+#else
+  char *bytes = data;
+  size_t left = msg_size;
+  int ret;
+
+  while(left > MSG_CHUNK_SIZE) {
+    ret = MPI_Recv(bytes, MSG_CHUNK_SIZE, MPI_BYTE, source, tag, comm,
+        MPI_STATUS_IGNORE);
+    if(ret != MPI_SUCCESS)
+      return ret;
+    bytes += MSG_CHUNK_SIZE;
+    left -= MSG_CHUNK_SIZE;
+  }
+  return MPI_Recv(bytes, (int) left, MPI_BYTE, source, tag, comm,
+      MPI_STATUS_IGNORE);
+#endif
+}
+
+/* number of requests msg_isend()/msg_irecv() need for msg_size bytes */
+unsigned int
+msg_nr_requests(const size_t msg_size)
+{
+#if MSG_LARGE_COUNT
+  (void) msg_size;
+  return 1;
+#else
+  return msg_size <= MSG_CHUNK_SIZE ? 1 : (msg_size + MSG_CHUNK_SIZE - 1) / MSG_CHUNK_SIZE;
+#endif
+}
+
+/*
+ * Non-blocking counterparts of msg_send() and msg_recv(), reqs must have
+ * room for msg_nr_requests(msg_size) requests.
+ */
+int
+msg_isend(const void *data, const size_t msg_size, int dest, int tag,
+	  MPI_Comm comm, MPI_Request *reqs)
+{
+#if MSG_LARGE_COUNT
+  return MPI_Isend_c(data, (MPI_Count) msg_size, MPI_BYTE, dest, tag, comm, reqs);
+#else
+  const char *bytes = data;
+  size_t left = msg_size;
+  int ret;
+
+  while(left > MSG_CHUNK_SIZE) {
+    ret = MPI_Isend(bytes, MSG_CHUNK_SIZE, MPI_BYTE, dest, tag, comm, reqs++);
+    if(ret != MPI_SUCCESS)
+      return ret;
+    bytes += MSG_CHUNK_SIZE;
+    left -= MSG_CHUNK_SIZE;
+  }
+  return MPI_Isend(bytes, (int) left, MPI_BYTE, dest, tag, comm, reqs);
+#endif
+}
+
+int
+msg_irecv(void *data, const size_t msg_size, int source, int tag,
+	  MPI_Comm comm, MPI_Request *reqs)
+{
+#if MSG_LARGE_COUNT
+  return MPI_Irecv_c(data, (MPI_Count) msg_size, MPI_BYTE, source, tag, comm, reqs);
+#else
+  char *bytes = data;
+  size_t left = msg_size;
+  int ret;
+
+  while(left > MSG_CHUNK_SIZE) {
+    ret = MPI_Irecv(bytes, MSG_CHUNK_SIZE, MPI_BYTE, source, tag, comm, reqs++);
+    if(ret != MPI_SUCCESS)
+      return ret;
+    bytes += MSG_CHUNK_SIZE;
+    left -= MSG_CHUNK_SIZE;
+  }
+  return MPI_Irecv(bytes, (int) left, MPI_BYTE, source, tag, comm, reqs);
+#endif
+}
+
+/* persistent counterparts of msg_isend() and msg_irecv() */
+int
+msg_send_init(const void *data, const size_t msg_size, int dest, int tag,
+	      MPI_Comm comm, MPI_Request *reqs)
+{
+#if MSG_LARGE_COUNT
+  return MPI_Send_init_c(data, (MPI_Count) msg_size, MPI_BYTE, dest, tag, comm, reqs);
+#else
+  const char *bytes = data;
+  size_t left = msg_size;
+  int ret;
+
+  while(left > MSG_CHUNK_SIZE) {
+    ret = MPI_Send_init(bytes, MSG_CHUNK_SIZE, MPI_BYTE, dest, tag, comm, reqs++);
+    if(ret != MPI_SUCCESS)
+      return ret;
+    bytes += MSG_CHUNK_SIZE;
+    left -= MSG_CHUNK_SIZE;
+  }
+  return MPI_Send_init(bytes, (int) left, MPI_BYTE, dest, tag, comm, reqs);
+#endif
+}
+
+int
+msg_recv_init(void *data, const size_t msg_size, int source, int tag,
+	      MPI_Comm comm, MPI_Request *reqs)
+{
+#if MSG_LARGE_COUNT
+  return MPI_Recv_init_c(data, (MPI_Count) msg_size, MPI_BYTE, source, tag, comm, reqs);
+#else
+  char *bytes = data;
+  size_t left = msg_size;
+  int ret;
+
+  while(left > MSG_CHUNK_SIZE) {
+    ret = MPI_Recv_init(bytes, MSG_CHUNK_SIZE, MPI_BYTE, source, tag, comm, reqs++);
+    if(ret != MPI_SUCCESS)
+      return ret;
+    bytes += MSG_CHUNK_SIZE;
+    left -= MSG_CHUNK_SIZE;
+  }
+  return MPI_Recv_init(bytes, (int) left, MPI_BYTE, source, tag, comm, reqs);
+#endif
+}
+
+void
+round_trip_func(struct msg_buf *buf,
+		uint64_t *snd_time,
+		uint64_t *rcv_time,
 		int tag)
 {
-  assert(msg_size >= 3);
-  int * data = calloc(msg_size,sizeof(int));
+  const size_t msg_size = buf->msg_size;
+  char * data = msg_buf_get(buf);
   int msg_id = MAGIC_ID;
-  struct timespec time_start, time_end;
+  uint64_t time_start, time_end;
 
-  data[0] = MAGIC_START; data[msg_size-1] = MAGIC_END;
-  data[1] = tag;
+  msg_header_write(data, msg_size, tag);
 
   if(world_rank != 0) {
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Recv(data, msg_size, MPI_INT, world_rank - 1,
-	     msg_id, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end, &time_start, rcv_time);
+    time_start = timer_read();
+    msg_recv(data, msg_size, world_rank - 1,
+	     msg_id, MPI_COMM_WORLD);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
   } else {
     if(tag == -1) {
-      for(unsigned int i = 2; i < msg_size-1; i++) {
-        data[i] = rand();
-      }
+      msg_fill_random(data, msg_size);
     }
   }
 
-  clock_gettime(CLOCK_MONOTONIC, &time_start);
-  MPI_Send(data, msg_size, MPI_INT,
+  time_start = timer_read();
+  msg_send(data, msg_size,
       (world_rank + 1) % world_size,
 	   msg_id, MPI_COMM_WORLD);
-  clock_gettime(CLOCK_MONOTONIC, &time_end);
-  tlog_timespec_sub(&time_end, &time_start, snd_time );
+  time_end = timer_read();
+  *snd_time = leg_done(leg_snd, time_start, time_end);
 
   if(world_rank == 0) {
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Recv(data, msg_size, MPI_INT, world_size-1,
-	     msg_id, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end, &time_start, rcv_time);
+    time_start = timer_read();
+    msg_recv(data, msg_size, world_size-1,
+	     msg_id, MPI_COMM_WORLD);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
   }
 
-  free(data);
+  if(msg_verify.enabled)
+    msg_check(data, msg_size, tag);
+  msg_buf_put(buf, data);
 }
 
 void
-round_trip_total_func(const unsigned int msg_size,
-		      struct timespec *snd_time,
+round_trip_total_func(struct msg_buf *buf,
+		      uint64_t *snd_time,
 		      int tag)
 {
- assert(msg_size >= 3);
-  int * data = calloc(msg_size,sizeof(int));
+  const size_t msg_size = buf->msg_size;
+  char * data = msg_buf_get(buf);
   int msg_id = MAGIC_ID;
-  struct timespec time_start, time_end;
+  uint64_t time_start, time_end;
 
-  data[0] = MAGIC_START; data[msg_size-1] = MAGIC_END;
-  data[1] = tag;
+  msg_header_write(data, msg_size, tag);
 
   if(world_rank == 0 && tag == -1) {
-    for(unsigned int i = 2; i < msg_size-1; i++) {
-      data[i] = rand();
-    }
+    msg_fill_random(data, msg_size);
   }
 
-  clock_gettime(CLOCK_MONOTONIC, &time_start);
+  time_start = timer_read();
 
   if(world_rank != 0) {
-    MPI_Recv(data, msg_size, MPI_INT, world_rank - 1,
-	     msg_id, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    msg_recv(data, msg_size, world_rank - 1,
+	     msg_id, MPI_COMM_WORLD);
   }
 
-  MPI_Send(data, msg_size, MPI_INT,
+  msg_send(data, msg_size,
       (world_rank + 1) % world_size,
 	   msg_id, MPI_COMM_WORLD);
 
   if(world_rank == 0) {
-    MPI_Recv(data, msg_size, MPI_INT, world_size-1,
-	     msg_id, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    msg_recv(data, msg_size, world_size-1,
+	     msg_id, MPI_COMM_WORLD);
   }
 
-  clock_gettime(CLOCK_MONOTONIC, &time_end);
-  tlog_timespec_sub(&time_end, &time_start, snd_time );
+  time_end = timer_read();
+  *snd_time = leg_done(leg_snd, time_start, time_end);
 
-  free(data);
+  if(msg_verify.enabled)
+    msg_check(data, msg_size, tag);
+  msg_buf_put(buf, data);
 }
 
-void dround_trip_func(const unsigned int msg_size,
-		      struct timespec *snd_time,
-		      struct timespec *rcv_time,
+void dround_trip_func(struct msg_buf *buf,
+		      uint64_t *snd_time,
+		      uint64_t *rcv_time,
 		      int tag) {
-  assert(msg_size >= 3);
-  int * data = calloc(msg_size,sizeof(int));
-  data[0] = MAGIC_START; data[msg_size-1] = MAGIC_END;
-  data[1] = tag;
+  const size_t msg_size = buf->msg_size;
+  char * data = msg_buf_get(buf);
+  msg_header_write(data, msg_size, tag);
   int msg_id = MAGIC_ID;
-  struct timespec time_start, time_end;
+  uint64_t time_start, time_end;
   if(world_rank != 0) {
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Recv(data,msg_size,MPI_INT,
-        world_rank - 1,msg_id,MPI_COMM_WORLD,MPI_STATUS_IGNORE);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end,&time_start,rcv_time);
+    time_start = timer_read();
+    msg_recv(data,msg_size,
+        world_rank - 1,msg_id,MPI_COMM_WORLD);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
   } else {
     if(tag == -1) {
-      for(unsigned int i = 2; i < msg_size-1; i++) {
-        data[i] = rand();
-      }
+      msg_fill_random(data, msg_size);
     }
   }
-  clock_gettime(CLOCK_MONOTONIC, &time_start);
-  MPI_Send(data,msg_size,MPI_INT,
+  time_start = timer_read();
+  msg_send(data,msg_size,
       (world_rank + 1) % world_size,msg_id,MPI_COMM_WORLD);
-  clock_gettime(CLOCK_MONOTONIC, &time_end);
-  tlog_timespec_sub(&time_end,&time_start,snd_time );
+  time_end = timer_read();
+  *snd_time = leg_done(leg_snd, time_start, time_end);
   if(world_rank == 0) {
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Recv(data,msg_size,MPI_INT,
-        world_size-1,msg_id,MPI_COMM_WORLD,MPI_STATUS_IGNORE);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end,&time_start,rcv_time);
+    time_start = timer_read();
+    msg_recv(data,msg_size,
+        world_size-1,msg_id,MPI_COMM_WORLD);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
   }
   /* and again, so the first times are overwritten */
   if(world_rank != 0) {
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Recv(data,msg_size,MPI_INT,
-        world_rank - 1,msg_id,MPI_COMM_WORLD,MPI_STATUS_IGNORE);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end,&time_start,rcv_time);
+    time_start = timer_read();
+    msg_recv(data,msg_size,
+        world_rank - 1,msg_id,MPI_COMM_WORLD);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
   } else {
     if(tag == -1) {
-      for(unsigned int i = 2; i < msg_size-1; i++) {
-        data[i] = rand();
-      }
+      msg_fill_random(data, msg_size);
     }
   }
-  clock_gettime(CLOCK_MONOTONIC, &time_start);
-  MPI_Send(data,msg_size,MPI_INT,
+  time_start = timer_read();
+  msg_send(data,msg_size,
       (world_rank + 1) % world_size,msg_id,MPI_COMM_WORLD);
-  clock_gettime(CLOCK_MONOTONIC, &time_end);
-  tlog_timespec_sub(&time_end,&time_start,snd_time );
+  time_end = timer_read();
+  *snd_time = leg_done(leg_snd, time_start, time_end);
   if(world_rank == 0) {
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Recv(data,msg_size,MPI_INT,
-        world_size-1,msg_id,MPI_COMM_WORLD,MPI_STATUS_IGNORE);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end,&time_start,rcv_time);
+    time_start = timer_read();
+    msg_recv(data,msg_size,
+        world_size-1,msg_id,MPI_COMM_WORLD);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
   }
 
-  free(data);
+  if(msg_verify.enabled)
+    msg_check(data, msg_size, tag);
+  msg_buf_put(buf, data);
 }
 
 void
-round_trip_sync_func(const unsigned int msg_size,
-		     struct timespec *snd_time,
-		     struct timespec *rcv_time,
+round_trip_sync_func(struct msg_buf *buf,
+		     uint64_t *snd_time,
+		     uint64_t *rcv_time,
 		     int tag)
 {
   if(MPI_Barrier(MPI_COMM_WORLD) != MPI_SUCCESS) {
@@ -167,298 +581,643 @@ round_trip_sync_func(const unsigned int msg_size,
     MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
     exit(EXIT_FAILURE);
   }
-  round_trip_func(msg_size, snd_time, rcv_time, tag);
+  round_trip_func(buf, snd_time, rcv_time, tag);
 }
 
 void
-round_trip_wait_func(const unsigned int msg_size,
-		     struct timespec *snd_time,
-		     struct timespec *rcv_time,
+round_trip_wait_func(struct msg_buf *buf,
+		     uint64_t *snd_time,
+		     uint64_t *rcv_time,
 		     int tag,
 		     unsigned int wait) {
   usleep(wait);
-  round_trip_func(msg_size, snd_time, rcv_time, tag);
+  round_trip_func(buf, snd_time, rcv_time, tag);
 }
 
 void
-round_trip_msg_size_func(const unsigned int msg_size,
-			 struct timespec *snd_time,
-			 struct timespec *rcv_time,
-			 struct timespec* probe_time,
+round_trip_msg_size_func(struct msg_buf *buf,
+			 uint64_t *snd_time,
+			 uint64_t *rcv_time,
+			 uint64_t *probe_time,
 			 int tag) {
-  assert(msg_size >= 3);
-  int * data = calloc(msg_size,sizeof(int));
-  int msg_id = MAGIC_ID, msg_size_status = 0;
+  const size_t msg_size = buf->msg_size;
+  char * data = msg_buf_get(buf);
+  int msg_id = MAGIC_ID;
+  MPI_Count msg_size_status = 0;
   MPI_Status status;
-  struct timespec time_start, time_end ;
+  uint64_t time_start, time_end;
 
-  data[0] = MAGIC_START; data[msg_size-1] = MAGIC_END;
-  data[1] = tag;
+  msg_header_write(data, msg_size, tag);
 
   if(world_rank != 0) {
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
+    time_start = timer_read();
     MPI_Probe(world_rank-1,msg_id, MPI_COMM_WORLD, &status);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end, &time_start, probe_time);
+    time_end = timer_read();
+    *probe_time = leg_done(leg_prb, time_start, time_end);
 
-    MPI_Get_count(&status, MPI_INT, &msg_size_status);
-    if(msg_size_status != (int) msg_size) {
-      fprintf(stderr, "Messages sizes differs on rank %i: %i <-> %i\n",
-          world_rank, msg_size_status, msg_size);
+    MPI_Get_elements_x(&status, MPI_BYTE, &msg_size_status);
+    if((size_t) msg_size_status != msg_chunk_size(msg_size)) {
+      fprintf(stderr, "Messages sizes differs on rank %i: %lli <-> %zu\n",
+          world_rank, (long long) msg_size_status, msg_chunk_size(msg_size));
       exit(EXIT_FAILURE);
     }
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Recv(data,msg_size, MPI_INT, world_rank - 1,
-	     msg_id, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end, &time_start, rcv_time);
+    time_start = timer_read();
+    msg_recv(data,msg_size, world_rank - 1,
+	     msg_id, MPI_COMM_WORLD);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
   } else {
     if(tag == -1) {
-      for(unsigned int i = 2; i < msg_size-1; i++) {
-        data[i] = rand();
-      }
+      msg_fill_random(data, msg_size);
     }
   }
 
-  clock_gettime(CLOCK_MONOTONIC, &time_start);
-  MPI_Send(data, msg_size, MPI_INT,
+  time_start = timer_read();
+  msg_send(data, msg_size,
 	   (world_rank + 1) % world_size,
 	   msg_id, MPI_COMM_WORLD);
-  clock_gettime(CLOCK_MONOTONIC, &time_end);
-  tlog_timespec_sub(&time_end, &time_start, snd_time );
+  time_end = timer_read();
+  *snd_time = leg_done(leg_snd, time_start, time_end);
 
   if(world_rank == 0) {
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
+    time_start = timer_read();
     MPI_Probe(world_size - 1, msg_id, MPI_COMM_WORLD, &status);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end, &time_start, probe_time);
+    time_end = timer_read();
+    *probe_time = leg_done(leg_prb, time_start, time_end);
 
-    MPI_Get_count(&status, MPI_INT, &msg_size_status);
-    if(msg_size_status != (int) msg_size) {
-      fprintf(stderr,"Messages sizes differs on rank %i: %i <-> %i\n",
-          world_rank, msg_size_status, msg_size);
+    MPI_Get_elements_x(&status, MPI_BYTE, &msg_size_status);
+    if((size_t) msg_size_status != msg_chunk_size(msg_size)) {
+      fprintf(stderr,"Messages sizes differs on rank %i: %lli <-> %zu\n",
+          world_rank, (long long) msg_size_status, msg_chunk_size(msg_size));
       exit(EXIT_FAILURE);
     }
 
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Recv(data, msg_size, MPI_INT, world_size - 1,
-	     msg_id, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end, &time_start, rcv_time);
+    time_start = timer_read();
+    msg_recv(data, msg_size, world_size - 1,
+	     msg_id, MPI_COMM_WORLD);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
   }
 
-  free(data);
+  if(msg_verify.enabled)
+    msg_check(data, msg_size, tag);
+  msg_buf_put(buf, data);
 }
 
 void
-send_func(const unsigned int msg_size,
-	  struct timespec *snd_time,
-	  struct timespec *rcv_time,
+send_func(struct msg_buf *buf,
+	  uint64_t *snd_time,
+	  uint64_t *rcv_time,
 	  int tag) {
-  assert(msg_size >= 3);
+  const size_t msg_size = buf->msg_size;
   assert(world_size % 2 == 0);
-  int * data = calloc(msg_size,sizeof(int));
+  char * data = msg_buf_get(buf);
   int msg_id = MAGIC_ID;
-  struct timespec time_start, time_end;
+  uint64_t time_start, time_end;
 
-  data[0] = MAGIC_START; data[msg_size-1] = MAGIC_END;
-  data[1] = tag;
+  msg_header_write(data, msg_size, tag);
 
   if(world_rank % 2 != 0) {
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Recv(data,msg_size,MPI_INT, world_rank - 1,
-	     msg_id, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end, &time_start, rcv_time);
+    time_start = timer_read();
+    msg_recv(data,msg_size, world_rank - 1,
+	     msg_id, MPI_COMM_WORLD);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
   } else {
     if(tag == -1) {
-      for(unsigned int i = 2; i < msg_size-1; i++) {
-        data[i] = rand();
-      }
+      msg_fill_random(data, msg_size);
     }
 
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Send(data, msg_size, MPI_INT,
+    time_start = timer_read();
+    msg_send(data, msg_size,
 	     (world_rank + 1) % world_size,
 	     msg_id, MPI_COMM_WORLD);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end, &time_start, snd_time );
+    time_end = timer_read();
+    *snd_time = leg_done(leg_snd, time_start, time_end);
   }
-  free(data);
+  if(msg_verify.enabled && world_rank % 2 != 0)
+    msg_check(data, msg_size, tag);
+  msg_buf_put(buf, data);
+}
+
+/* start the persistent requests and wait for them */
+static inline void
+persist_run(MPI_Request *reqs, unsigned int nr_reqs)
+{
+  MPI_Startall(nr_reqs, reqs);
+  MPI_Waitall(nr_reqs, reqs, MPI_STATUSES_IGNORE);
 }
 
-void send_delay_func(const unsigned int msg_size,
-		     struct timespec *snd_time,
-		     struct timespec *rcv_time,
+/*
+ * round_trip_func() with the requests set up once per message size by
+ * msg_buf_persist(), to the next rank and from the previous one
+ */
+void
+round_trip_persist_func(struct msg_buf *buf,
+			uint64_t *snd_time,
+			uint64_t *rcv_time,
+			int tag)
+{
+  const size_t msg_size = buf->msg_size;
+  char * data = buf->data;
+  uint64_t time_start, time_end;
+
+  msg_header_write(data, msg_size, tag);
+
+  if(world_rank != 0) {
+    time_start = timer_read();
+    persist_run(buf->prcv, buf->nr_preqs);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
+  } else {
+    if(tag == -1) {
+      msg_fill_random(data, msg_size);
+    }
+  }
+
+  time_start = timer_read();
+  persist_run(buf->psnd, buf->nr_preqs);
+  time_end = timer_read();
+  *snd_time = leg_done(leg_snd, time_start, time_end);
+
+  if(world_rank == 0) {
+    time_start = timer_read();
+    persist_run(buf->prcv, buf->nr_preqs);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
+  }
+  if(msg_verify.enabled)
+    msg_check(data, msg_size, tag);
+}
+
+/* send_func() with persistent requests, from the even to the odd rank */
+void
+send_persist_func(struct msg_buf *buf,
+		  uint64_t *snd_time,
+		  uint64_t *rcv_time,
+		  int tag) {
+  const size_t msg_size = buf->msg_size;
+  assert(world_size % 2 == 0);
+  char * data = buf->data;
+  uint64_t time_start, time_end;
+
+  msg_header_write(data, msg_size, tag);
+
+  if(world_rank % 2 != 0) {
+    time_start = timer_read();
+    persist_run(buf->prcv, buf->nr_preqs);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
+  } else {
+    if(tag == -1) {
+      msg_fill_random(data, msg_size);
+    }
+
+    time_start = timer_read();
+    persist_run(buf->psnd, buf->nr_preqs);
+    time_end = timer_read();
+    *snd_time = leg_done(leg_snd, time_start, time_end);
+  }
+  if(msg_verify.enabled && world_rank % 2 != 0)
+    msg_check(data, msg_size, tag);
+}
+
+void send_delay_func(struct msg_buf *buf,
+		     uint64_t *snd_time,
+		     uint64_t *rcv_time,
 		     int tag,
 		     unsigned int delay) {
-  assert(msg_size >= 3);
+  const size_t msg_size = buf->msg_size;
   assert(world_size % 2 == 0);
-  int * data = calloc(msg_size,sizeof(int));
-  data[0] = MAGIC_START; data[msg_size-1] = MAGIC_END;
-  data[1] = tag;
+  char * data = msg_buf_get(buf);
+  msg_header_write(data, msg_size, tag);
   int msg_id = MAGIC_ID;
-  struct timespec time_start, time_end;
+  uint64_t time_start, time_end;
   if(world_rank % 2 != 0) {
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Recv(data, msg_size, MPI_INT,
+    time_start = timer_read();
+    msg_recv(data, msg_size,
 	     world_rank - 1,
-	     msg_id, MPI_COMM_WORLD,
-	     MPI_STATUS_IGNORE);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end,&time_start,rcv_time);
+	     msg_id, MPI_COMM_WORLD);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
   } else {
     if(tag == -1) {
-      for(unsigned int i = 2; i < msg_size-1; i++) {
-        data[i] = rand();
-      }
+      msg_fill_random(data, msg_size);
     }
     usleep(delay);
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Send(data, msg_size, MPI_INT,
+    time_start = timer_read();
+    msg_send(data, msg_size,
 	     (world_rank + 1) % world_size,
 	     msg_id, MPI_COMM_WORLD);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end,&time_start,snd_time );
+    time_end = timer_read();
+    *snd_time = leg_done(leg_snd, time_start, time_end);
   }
-  free(data);
+  if(msg_verify.enabled && world_rank % 2 != 0)
+    msg_check(data, msg_size, tag);
+  msg_buf_put(buf, data);
 }
 
 void
-round_trip_delayed_func(const unsigned int msg_size,
-			struct timespec *snd_time,
-			struct timespec *rcv_time,
+round_trip_delayed_func(struct msg_buf *buf,
+			uint64_t *snd_time,
+			uint64_t *rcv_time,
 			int tag,
 			unsigned int delay) {
-  assert(msg_size >= 3);
-  int * data = calloc(msg_size,sizeof(int));
+  const size_t msg_size = buf->msg_size;
+  char * data = msg_buf_get(buf);
   int msg_id = MAGIC_ID;
-  struct timespec time_start, time_end;
+  uint64_t time_start, time_end;
 
-  data[0] = MAGIC_START; data[msg_size-1] = MAGIC_END;
-  data[1] = tag;
+  msg_header_write(data, msg_size, tag);
 
   if(world_rank != 0) {
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Recv(data, msg_size, MPI_INT,
+    time_start = timer_read();
+    msg_recv(data, msg_size,
 	     world_rank - 1,
-	     msg_id, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end, &time_start, rcv_time);
+	     msg_id, MPI_COMM_WORLD);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
   } else {
     if(tag == -1) {
-      for(unsigned int i = 2; i < msg_size-1; i++) {
-        data[i] = rand();
-      }
+      msg_fill_random(data, msg_size);
     }
   }
 
-  clock_gettime(CLOCK_MONOTONIC, &time_start);
-  MPI_Send(data, msg_size, MPI_INT,
+  time_start = timer_read();
+  msg_send(data, msg_size,
 	   (world_rank + 1) % world_size,
 	   msg_id, MPI_COMM_WORLD);
-  clock_gettime(CLOCK_MONOTONIC, &time_end);
-  tlog_timespec_sub(&time_end, &time_start, snd_time );
+  time_end = timer_read();
+  *snd_time = leg_done(leg_snd, time_start, time_end);
 
   if(world_rank == 0) {
     usleep(delay);
 
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Recv(data,msg_size,MPI_INT,
+    time_start = timer_read();
+    msg_recv(data,msg_size,
 	     world_size - 1,
-	     msg_id, MPI_COMM_WORLD,
-	     MPI_STATUS_IGNORE);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end, &time_start, rcv_time);
+	     msg_id, MPI_COMM_WORLD);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
   }
 
-  free(data);
+  if(msg_verify.enabled)
+    msg_check(data, msg_size, tag);
+  msg_buf_put(buf, data);
 }
 
 void
-single_trip_func(const unsigned int msg_size,
-		 struct timespec *snd_time,
-		 struct timespec *rcv_time,
+single_trip_func(struct msg_buf *buf,
+		 uint64_t *snd_time,
+		 uint64_t *rcv_time,
 		 int tag) {
-  assert(msg_size >= 3);
-  int * data = calloc(msg_size,sizeof(int));
+  const size_t msg_size = buf->msg_size;
+  char * data = msg_buf_get(buf);
   int msg_id = MAGIC_ID;
-  struct timespec time_start, time_end;
+  uint64_t time_start, time_end;
 
-  data[0] = MAGIC_START; data[msg_size - 1] = MAGIC_END;
-  data[1] = tag;
+  msg_header_write(data, msg_size, tag);
 
   if (world_rank != 0) {
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Recv(data, msg_size, MPI_INT,
+    time_start = timer_read();
+    msg_recv(data, msg_size,
 	     world_rank - 1, msg_id,
-	     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end, &time_start, rcv_time);
+	     MPI_COMM_WORLD);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
   } else {
     if (tag == -1) {
-      for (unsigned int i = 2; i < msg_size - 1; i++) {
-        data[i] = rand();
-      }
+      msg_fill_random(data, msg_size);
     }
   }
   if (world_rank < world_size - 1) {
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Send(data, msg_size, MPI_INT,
+    time_start = timer_read();
+    msg_send(data, msg_size,
 	     (world_rank + 1), msg_id,
 	     MPI_COMM_WORLD);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end, &time_start,snd_time);
+    time_end = timer_read();
+    *snd_time = leg_done(leg_snd, time_start, time_end);
   }
 
-  free(data);
+  if(msg_verify.enabled && world_rank != 0)
+    msg_check(data, msg_size, tag);
+  msg_buf_put(buf, data);
 }
 
 void
-round_trip_wait_recv_func(const unsigned int msg_size,
-			  struct timespec *snd_time,
-			  struct timespec *rcv_time,
+round_trip_wait_recv_func(struct msg_buf *buf,
+			  uint64_t *snd_time,
+			  uint64_t *rcv_time,
 			  int tag,
 			  unsigned int wait) {
-  assert(msg_size >= 3);
-  int * data = calloc(msg_size,sizeof(int));
+  const size_t msg_size = buf->msg_size;
+  char * data = msg_buf_get(buf);
   int msg_id = MAGIC_ID;
-  struct timespec time_start, time_end;
+  uint64_t time_start, time_end;
 
-  data[0] = MAGIC_START; data[msg_size-1] = MAGIC_END;
-  data[1] = tag;
+  msg_header_write(data, msg_size, tag);
 
   if (world_rank != 0) {
     usleep(wait);
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Recv(data,msg_size,MPI_INT,
+    time_start = timer_read();
+    msg_recv(data,msg_size,
 	     world_rank - 1, msg_id,
-	     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end, &time_start, rcv_time);
+	     MPI_COMM_WORLD);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
   } else {
     if (tag == -1) {
-      for (unsigned int i = 2; i < msg_size-1; i++) {
-        data[i] = rand();
-      }
+      msg_fill_random(data, msg_size);
     }
   }
 
-  clock_gettime(CLOCK_MONOTONIC, &time_start);
-  MPI_Send(data,msg_size,MPI_INT,
+  time_start = timer_read();
+  msg_send(data,msg_size,
 	   (world_rank + 1) % world_size, msg_id,
 	   MPI_COMM_WORLD);
-  clock_gettime(CLOCK_MONOTONIC, &time_end);
-  tlog_timespec_sub(&time_end,&time_start,snd_time );
+  time_end = timer_read();
+  *snd_time = leg_done(leg_snd, time_start, time_end);
 
   if (world_rank == 0) {
-    clock_gettime(CLOCK_MONOTONIC, &time_start);
-    MPI_Recv(data,msg_size,MPI_INT,
+    time_start = timer_read();
+    msg_recv(data,msg_size,
 	     world_size - 1, msg_id,
-	     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    clock_gettime(CLOCK_MONOTONIC, &time_end);
-    tlog_timespec_sub(&time_end,&time_start,rcv_time);
+	     MPI_COMM_WORLD);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
+  }
+
+  if(msg_verify.enabled)
+    msg_check(data, msg_size, tag);
+  msg_buf_put(buf, data);
+}
+
+/*
+ * osu_bw like streaming test: the even ranks post window non-blocking
+ * sends to their odd partner, which has posted the matching receives,
+ * and wait for a zero byte acknowledgement once all of them completed.
+ */
+void
+send_bw_func(struct msg_buf *buf,
+	     uint64_t *snd_time,
+	     uint64_t *rcv_time,
+	     int tag,
+	     unsigned int window) {
+  const size_t msg_size = buf->msg_size;
+  assert(world_size % 2 == 0);
+  char * data = msg_buf_get(buf);
+  int msg_id = MAGIC_ID;
+  unsigned int nr_reqs = msg_nr_requests(msg_size);
+  MPI_Request *reqs = msg_buf_reqs(buf, window * nr_reqs);
+  uint64_t time_start, time_end;
+
+  msg_header_write(data, msg_size, tag);
+
+  if(world_rank % 2 != 0) {
+    time_start = timer_read();
+    for(unsigned int i = 0; i < window; i++) {
+      msg_irecv(data, msg_size, world_rank - 1,
+		msg_id, MPI_COMM_WORLD, &reqs[i * nr_reqs]);
+    }
+    MPI_Waitall(window * nr_reqs, reqs, MPI_STATUSES_IGNORE);
+    time_end = timer_read();
+    *rcv_time = leg_done(leg_rcv, time_start, time_end);
+    MPI_Send(NULL, 0, MPI_BYTE, world_rank - 1,
+	     msg_id + 1, MPI_COMM_WORLD);
+  } else {
+    if(tag == -1) {
+      msg_fill_random(data, msg_size);
+    }
+
+    time_start = timer_read();
+    for(unsigned int i = 0; i < window; i++) {
+      msg_isend(data, msg_size, world_rank + 1,
+		msg_id, MPI_COMM_WORLD, &reqs[i * nr_reqs]);
+    }
+    MPI_Waitall(window * nr_reqs, reqs, MPI_STATUSES_IGNORE);
+    MPI_Recv(NULL, 0, MPI_BYTE, world_rank + 1,
+	     msg_id + 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    time_end = timer_read();
+    *snd_time = leg_done(leg_snd, time_start, time_end);
+  }
+  if(msg_verify.enabled && world_rank % 2 != 0)
+    msg_check(data, msg_size, tag);
+  msg_buf_put(buf, data);
+}
+
+/*
+ * osu_bibw like test: both partners of a pair post window receives and
+ * window sends at the same time. The send and receive times are taken
+ * when the last request of the respective direction completed.
+ */
+void
+send_bibw_func(struct msg_buf *buf,
+	       uint64_t *snd_time,
+	       uint64_t *rcv_time,
+	       int tag,
+	       unsigned int window) {
+  const size_t msg_size = buf->msg_size;
+  assert(world_size % 2 == 0);
+  char * data = msg_buf_get(buf);
+  char * rdata = msg_buf_get_recv(buf, msg_size);
+  int msg_id = MAGIC_ID, index;
+  int partner = world_rank % 2 != 0 ? world_rank - 1 : world_rank + 1;
+  unsigned int nr_reqs = msg_nr_requests(msg_size);
+  unsigned int nr_rcv = window * nr_reqs;
+  MPI_Request *reqs = msg_buf_reqs(buf, 2 * nr_rcv);
+  uint64_t time_start, time_end;
+
+  msg_header_write(data, msg_size, tag);
+  if(tag == -1) {
+    msg_fill_random(data, msg_size);
+  }
+
+  time_start = timer_read();
+  for(unsigned int i = 0; i < window; i++) {
+    msg_irecv(rdata, msg_size, partner,
+	      msg_id, MPI_COMM_WORLD, &reqs[i * nr_reqs]);
+  }
+  for(unsigned int i = 0; i < window; i++) {
+    msg_isend(data, msg_size, partner,
+	      msg_id, MPI_COMM_WORLD, &reqs[nr_rcv + i * nr_reqs]);
+  }
+  for(unsigned int rcv_left = nr_rcv, snd_left = nr_rcv;
+      rcv_left > 0 || snd_left > 0;) {
+    MPI_Waitany(2 * nr_rcv, reqs, &index, MPI_STATUS_IGNORE);
+    if((unsigned int) index < nr_rcv) {
+      if(--rcv_left == 0) {
+        time_end = timer_read();
+        *rcv_time = leg_done(leg_rcv, time_start, time_end);
+      }
+    } else {
+      if(--snd_left == 0) {
+        time_end = timer_read();
+        *snd_time = leg_done(leg_snd, time_start, time_end);
+      }
+    }
+  }
+  if(msg_verify.enabled)
+    msg_check(rdata, msg_size, tag);
+  msg_buf_put(buf, rdata);
+  msg_buf_put(buf, data);
+}
+
+/*
+ * Index of the even/odd pair of this rank among the pairs whose even rank
+ * lives on the same node, the largest number of such pairs on any node
+ * is returned in max_pairs. Collective over MPI_COMM_WORLD.
+ */
+unsigned int
+node_pair_index(unsigned int *max_pairs)
+{
+  MPI_Comm node_comm;
+  int is_even = world_rank % 2 == 0, index = 0, node_rank, max;
+
+  assert(world_size % 2 == 0);
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, world_rank,
+      MPI_INFO_NULL, &node_comm);
+  MPI_Comm_rank(node_comm, &node_rank);
+  MPI_Exscan(&is_even, &index, 1, MPI_INT, MPI_SUM, node_comm);
+  if(node_rank == 0)
+    index = 0;
+  MPI_Comm_free(&node_comm);
+
+  /* the odd rank uses the index of its even partner */
+  if(is_even)
+    MPI_Send(&index, 1, MPI_INT, world_rank + 1, MAGIC_ID, MPI_COMM_WORLD);
+  else
+    MPI_Recv(&index, 1, MPI_INT, world_rank - 1, MAGIC_ID, MPI_COMM_WORLD,
+        MPI_STATUS_IGNORE);
+
+  max = index + 1;
+  MPI_Allreduce(MPI_IN_PLACE, &max, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+  *max_pairs = max;
+  return index;
+}
+
+/*
+ * Node of every rank, numbered by the lowest world rank on the node, as
+ * MPI_Comm_split_type(MPI_COMM_TYPE_SHARED) sees it. Collective over
+ * MPI_COMM_WORLD, the array is to be freed by the caller.
+ */
+int *
+node_map(void)
+{
+  MPI_Comm node_comm;
+  int node = world_rank;
+  int *node_of = malloc(world_size * sizeof(int));
+
+  if(node_of == NULL) {
+    fprintf(stderr, "Could not allocate the node map on rank %i\n", world_rank);
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
+  /* ordered by world rank, so rank 0 of the node has the lowest one */
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, world_rank,
+      MPI_INFO_NULL, &node_comm);
+  MPI_Bcast(&node, 1, MPI_INT, 0, node_comm);
+  MPI_Comm_free(&node_comm);
+  MPI_Allgather(&node, 1, MPI_INT, node_of, 1, MPI_INT, MPI_COMM_WORLD);
+  return node_of;
+}
+
+/*
+ * Message rate: like send_bw, but only the pairs which are active take
+ * part, so the rate can be measured for an increasing number of
+ * concurrent pairs per node.
+ */
+void
+msg_rate_func(struct msg_buf *buf,
+	      uint64_t *snd_time,
+	      uint64_t *rcv_time,
+	      int tag,
+	      unsigned int window,
+	      unsigned int active) {
+  if(!active)
+    return;
+  send_bw_func(buf, snd_time, rcv_time, tag, window);
+}
+
+/* number of MPI_INT in a collective block of msg_size bytes */
+static int
+coll_count(const size_t msg_size)
+{
+  size_t count = msg_size / sizeof(int);
+
+  if(count > INT_MAX) {
+    fprintf(stderr, "Message size %zu is too large for collectives on rank %i\n",
+        msg_size, world_rank);
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
+  return count;
+}
+
+/*
+ * Time one collective operation on MPI_INT. msg_size is the size of the
+ * whole message for allreduce, reduce and bcast and the size of the
+ * block per rank for allgather, alltoall and reduce_scatter_block.
+ */
+void
+collective_func(struct msg_buf *buf,
+		uint64_t *snd_time,
+		int tag,
+		enum coll_op op) {
+  const size_t msg_size = buf->msg_size;
+  const int count = coll_count(msg_size);
+  /* everything the operation receives, and for alltoall and
+     reduce_scatter_block also sends, from all ranks */
+  const size_t total = (size_t) count * sizeof(int) * world_size;
+  char * data = msg_buf_get(buf);
+  char * rdata = NULL, * sdata = data;
+  uint64_t time_start, time_end;
+
+  msg_header_write(data, msg_size, tag);
+  if(tag == -1) {
+    msg_fill_random(data, msg_size);
+  }
+
+  switch(op) {
+    case coll_alltoall:
+    case coll_reduce_scatter:
+      rdata = msg_buf_get_recv(buf, 2 * total);
+      sdata = rdata + total;
+      /* the same block to every rank */
+      for(int i = 0; i < world_size; i++)
+        memcpy(sdata + (size_t) i * count * sizeof(int), data, (size_t) count * sizeof(int));
+      break;
+    case coll_allgather:
+      rdata = msg_buf_get_recv(buf, total);
+      break;
+    case coll_bcast:
+      break;
+    default:
+      rdata = msg_buf_get_recv(buf, msg_size);
+      break;
+  }
+
+  time_start = timer_read();
+  switch(op) {
+    case coll_allreduce:
+      MPI_Allreduce(data, rdata, count, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+      break;
+    case coll_bcast:
+      MPI_Bcast(data, count, MPI_INT, 0, MPI_COMM_WORLD);
+      break;
+    case coll_reduce:
+      MPI_Reduce(data, rdata, count, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+      break;
+    case coll_allgather:
+      MPI_Allgather(data, count, MPI_INT, rdata, count, MPI_INT, MPI_COMM_WORLD);
+      break;
+    case coll_alltoall:
+      MPI_Alltoall(sdata, count, MPI_INT, rdata, count, MPI_INT, MPI_COMM_WORLD);
+      break;
+    case coll_reduce_scatter:
+      MPI_Reduce_scatter_block(sdata, rdata, count, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+      break;
   }
+  time_end = timer_read();
+  *snd_time = leg_done(leg_snd, time_start, time_end);
 
-  free(data);
+  msg_buf_put(buf, rdata);
+  msg_buf_put(buf, data);
 }
@@ -4,40 +4,184 @@
 #define MAGIC_START 232323
 #define MAGIC_END   424242
 #define MAGIC_ID    123123
+/* MAGIC_START, tag and MAGIC_END */
+#define MSG_HEADER_SIZE (3 * sizeof(int))
+/* MAGIC_START, tag, CRC32C of the payload and MAGIC_END with --verify */
+#define MSG_VERIFY_SIZE (4 * sizeof(int))
+#include <stdint.h>
 #include <time.h>
+#include <mpi.h>
+
+#include "timer.h"
+
+/*
+ * Use MPI_Send_c()/MPI_Recv_c() for messages of any size if the library
+ * implements MPI-4, otherwise split large messages into chunks.
+ * Compile with -DMSG_LARGE_COUNT=0 to force the chunked transfers.
+ */
+#ifndef MSG_LARGE_COUNT
+#if MPI_VERSION >= 4
+#define MSG_LARGE_COUNT 1
+#else
+#define MSG_LARGE_COUNT 0
+#endif
+#endif
+/* largest single message in the chunked fallback */
+#define MSG_CHUNK_SIZE (1 << 30)
 
 extern int world_rank;
 extern int world_size;
 
-void round_trip_func(const unsigned int msg_size, struct timespec *snd_time,
-    struct timespec *rcv_time, int tag);
-void dround_trip_func(const unsigned int msg_size, struct timespec *snd_time,
-    struct timespec *rcv_time, int tag);
-void round_trip_total_func(const unsigned int msg_size, struct timespec *snd_time,
+/* message buffer handed to the kernels, allocated once per message size */
+struct msg_buf {
+  void *data;
+  /* message size in bytes */
+  size_t msg_size;
+  size_t alloc_size;
+  /* separate receive buffer, see msg_buf_get_recv() */
+  void *rdata;
+  size_t rdata_size;
+  /* hand out a freshly calloc'ed buffer on every call, like in the old days */
+  unsigned fresh;
+  unsigned prefault;
+  /* requests for the non-blocking kernels */
+  MPI_Request *reqs;
+  unsigned int nr_reqs;
+  /* persistent requests on data, see msg_buf_persist() */
+  MPI_Request *psnd;
+  MPI_Request *prcv;
+  unsigned int nr_preqs;
+};
+
+int msg_buf_init(struct msg_buf *buf, const size_t msg_size,
+    unsigned prefault, unsigned fresh);
+void msg_buf_free(struct msg_buf *buf);
+void *msg_buf_get(struct msg_buf *buf);
+void *msg_buf_get_recv(struct msg_buf *buf, size_t size);
+void msg_buf_put(struct msg_buf *buf, void *data);
+MPI_Request *msg_buf_reqs(struct msg_buf *buf, unsigned int nr_reqs);
+int msg_buf_persist(struct msg_buf *buf, int dest, int source, int tag);
+
+size_t msg_chunk_size(const size_t msg_size);
+int msg_send(const void *data, const size_t msg_size, int dest, int tag,
+    MPI_Comm comm);
+int msg_recv(void *data, const size_t msg_size, int source, int tag,
+    MPI_Comm comm);
+unsigned int msg_nr_requests(const size_t msg_size);
+int msg_isend(const void *data, const size_t msg_size, int dest, int tag,
+    MPI_Comm comm, MPI_Request *reqs);
+int msg_irecv(void *data, const size_t msg_size, int source, int tag,
+    MPI_Comm comm, MPI_Request *reqs);
+int msg_send_init(const void *data, const size_t msg_size, int dest, int tag,
+    MPI_Comm comm, MPI_Request *reqs);
+int msg_recv_init(void *data, const size_t msg_size, int source, int tag,
+    MPI_Comm comm, MPI_Request *reqs);
+
+/*
+ * Payload verification: with enabled the header also carries the CRC32C
+ * of everything between it and MAGIC_END, which the kernels check with
+ * msg_check() after the last receive, outside the timed region
+ */
+struct msg_verify {
+  unsigned enabled;
+  /* failed checks since the last reset */
+  uint64_t failures;
+};
+
+extern struct msg_verify msg_verify;
+
+void msg_header_write(void *data, const size_t msg_size, int tag);
+void msg_fill_random(void *data, const size_t msg_size);
+int msg_check(const void *data, const size_t msg_size, int tag);
+
+enum leg {
+  leg_snd,
+  leg_rcv,
+  leg_prb,
+};
+
+/*
+ * timer_read() ticks of the begin and the end of every leg of the last
+ * kernel call, e.g. for the one-way latency between two ranks or tracing
+ */
+struct leg_stamps {
+  uint64_t begin[3];
+  uint64_t end[3];
+  /* bit 1 << leg for every leg this rank took part in */
+  unsigned int legs;
+};
+
+extern struct leg_stamps leg_stamps;
+
+/* record the leg and return its length in ns */
+static inline uint64_t
+leg_done(enum leg leg, uint64_t begin, uint64_t end)
+{
+  leg_stamps.begin[leg] = begin;
+  leg_stamps.end[leg] = end;
+  leg_stamps.legs |= 1u << leg;
+  return timer_elapsed(begin, end);
+}
+
+void round_trip_func(struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *rcv_time, int tag);
+void dround_trip_func(struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *rcv_time, int tag);
+void round_trip_total_func(struct msg_buf *buf, uint64_t *snd_time,
 			   int tag);
 
-void round_trip_sync_func(const unsigned int msg_size, struct timespec *snd_time,
-    struct timespec *rcv_time, int tag);
+void round_trip_sync_func(struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *rcv_time, int tag);
+
+void round_trip_wait_func(struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *rcv_time, int tag, unsigned int wait);
+
+void round_trip_msg_size_func(struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *rcv_time, uint64_t *probe_time, int tag);
+
+void send_func(struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *rcv_time, int tag);
+
+void round_trip_persist_func(struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *rcv_time, int tag);
+
+void send_persist_func(struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *rcv_time, int tag);
+
+void send_delay_func(struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *rcv_time,int tag, unsigned int delay);
+
+void round_trip_delayed_func(struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *rcv_time,int tag, unsigned int delay);
 
-void round_trip_wait_func(const unsigned int msg_size, struct timespec *snd_time,
-    struct timespec *rcv_time, int tag, unsigned int wait);
+void single_trip_func(struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *rcv_time, int tag);
 
-void round_trip_msg_size_func(const unsigned int msg_size, struct timespec *snd_time,
-    struct timespec *rcv_time, struct timespec* probe_time, int tag);
+void round_trip_wait_recv_func(struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *rcv_time, int tag, unsigned int wait);
 
-void send_func(const unsigned int msg_size, struct timespec *snd_time,
-    struct timespec *rcv_time, int tag);
+void send_bw_func(struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *rcv_time, int tag, unsigned int window);
 
-void send_delay_func(const unsigned int msg_size, struct timespec *snd_time,
-    struct timespec *rcv_time,int tag, unsigned int delay);
+void send_bibw_func(struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *rcv_time, int tag, unsigned int window);
 
-void round_trip_delayed_func(const unsigned int msg_size, struct timespec *snd_time,
-    struct timespec *rcv_time,int tag, unsigned int delay);
+enum coll_op {
+  coll_allreduce,
+  coll_bcast,
+  coll_reduce,
+  coll_allgather,
+  coll_alltoall,
+  coll_reduce_scatter,
+};
 
-void single_trip_func(const unsigned int msg_size, struct timespec *snd_time,
-    struct timespec *rcv_time, int tag);
+void collective_func(struct msg_buf *buf, uint64_t *snd_time,
+    int tag, enum coll_op op);
 
-void round_trip_wait_recv_func(const unsigned int msg_size, struct timespec *snd_time,
-    struct timespec *rcv_time, int tag, unsigned int wait);
+int *node_map(void);
+unsigned int node_pair_index(unsigned int *max_pairs);
+void msg_rate_func(struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *rcv_time, int tag, unsigned int window,
+    unsigned int active);
 
 #endif
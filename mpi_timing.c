@@ -23,35 +23,55 @@
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <assert.h>
 
 #include <mpi.h>
 
-#include <gsl/gsl_statistics.h>
-#include <gsl/gsl_sort.h>
-
 #include "tlog/timespec.h"
 
 #include "mpi_tests.h"
+#include "stats.h"
+#include "sample_file.h"
+#include "output.h"
+#include "timer.h"
+#include "clock_sync.h"
+#include "trace.h"
+#include "pair_matrix.h"
+#include "thread_rate.h"
+#include "rma.h"
+#include "datatype.h"
+#include "checksum.h"
 
 int world_rank = 0;
 int world_size = 0;
 
-int int_pow(int base, int exp) {
-    int result = 1;
-    for (;;)
-    {
-        if (exp & 1)
-            result *= base;
-        exp >>= 1;
-        if (!exp)
-            break;
-        base *= base;
-    }
+/* sanity limit, larger messages are sent in chunks or with large counts */
+#define MAX_MSG_SIZE ((size_t) 1 << 40)
+#define DEFAULT_SWEEP "64:96K"
+#define DEFAULT_PERCENTILES "90,99,99.9"
+#define MAX_PERCENTILES 16
+/*
+ * max min avg med var of every leg, then the percentiles of every leg and
+ * the hop class of every leg with --node-split
+ */
+#define MAX_RANK_VALS (15 + 3 * MAX_PERCENTILES + 3 + 1)
+#define COLUMN_NAME_LEN 32
+#define DEFAULT_EVOLUTION_MEMORY "64M"
+/* runs whose --one-way time stamps are exchanged at once */
+#define ONE_WAY_CHUNK 4096
 
-    return result;
-}
+static const char *leg_names[3] = { "snd", "rcv", "prb" };
+
+/* whether the peer of a leg is on the same node, see hop_class() */
+enum hop_class {
+  hop_none = -1,
+  hop_intra,
+  hop_inter,
+};
+static const char *hop_names[2] = { "intra", "inter" };
 
 enum run_mode {
   round_trip,
@@ -65,6 +85,27 @@ enum run_mode {
   send_delay,
   single_trip,
   round_trip_wait_recv,
+  round_trip_persist,
+  send_persist,
+  send_bw,
+  send_bibw,
+  msg_rate,
+  msg_rate_mt,
+  allreduce,
+  bcast,
+  reduce,
+  allgather,
+  alltoall,
+  reduce_scatter,
+  all_pairs,
+  rma_put,
+  rma_get,
+  rma_acc,
+  dt_contig_mode,
+  dt_vector_mode,
+  dt_indexed_mode,
+  dt_subarray_mode,
+  dt_manual_mode,
 };
 
 struct settings {
@@ -73,7 +114,43 @@ struct settings {
   unsigned wait;
   unsigned time_evolution;
   unsigned by_rank;
+  unsigned fresh_buffers;
+  unsigned prefault;
+  unsigned window;
+  unsigned pairs;
+  unsigned threads;
+  unsigned online;
+  double percentiles[MAX_PERCENTILES];
+  unsigned int nr_percentiles;
+  enum output_format format;
+  enum timer_source timer_source;
+  unsigned subtract_overhead;
+  unsigned one_way;
+  /* Chrome trace of every leg */
+  const char *trace_file;
+  size_t trace_events;
+  unsigned trace_align;
+  /* all_pairs also streams window messages for a bandwidth matrix */
+  unsigned matrix_bw;
+  /* separate statistics for intra-node and inter-node hops */
+  unsigned node_split;
+  /* one-sided modes */
+  enum rma_sync rma_sync;
+  unsigned rma_pair;
+  unsigned rma_ops;
+  /* ints between two payload ints in the datatype modes */
+  unsigned dt_stride;
+  /* check the header and checksum of every received message */
+  unsigned verify;
   enum run_mode mode;
+  const char *mode_name;
+  /* binary time evolution written with MPI-IO instead of the text one */
+  const char *evolution_file;
+  /* receive buffer budget of rank 0 for the text time evolution */
+  size_t evolution_memory;
+  /* message sizes in bytes */
+  size_t *sizes;
+  unsigned int nr_sizes;
 };
 
 void
@@ -87,28 +164,731 @@ usage(struct settings mysettings)
   printf("\t-t TIMES how many times to run the test, default is %i\n",mysettings.nr_runs);
   printf("\t-w MSEC to wait/delay after every round trip, default is %i\n",mysettings.wait);
   printf("\t-e print time evolution instead of min max mean media rms\n");
+  printf("\t-E FILE, --evolution-file FILE write the time evolution of all ranks in\n");
+  printf("\t   parallel to the binary FILE, mpi_timing_conv FILE prints it like -e\n");
+  printf("\t--evolution-memory BYTES gather the -e samples in chunks of at most BYTES\n");
+  printf("\t   on rank 0 (K, M or G suffix), default is %s\n", DEFAULT_EVOLUTION_MEMORY);
+  printf("\t-i print the statistics of every rank instead of the global ones\n");
+  printf("\t-m SIZES message sizes in bytes, default is %s\n", DEFAULT_SWEEP);
+  printf("\t   MIN:MAX      powers of two and the half steps in between\n");
+  printf("\t   MIN:MAX:xF   multiply by F after every size\n");
+  printf("\t   MIN:MAX:+N   add N after every size\n");
+  printf("\t   S1,S2,...    explicit list\n");
+  printf("\t   sizes may have a K, M or G suffix (powers of 1024), messages\n");
+  printf("\t   beyond 2 GiB use MPI-4 large counts or are sent in 1 GiB chunks\n");
+  printf("\t--online with -i keep only running statistics instead of all samples, so\n");
+  printf("\t   memory doesn't grow with -t, percentiles are exact to 1%%, ignored with -e\n");
+  printf("\t--percentiles P1,P2,... tail percentiles to print, default is %s\n",
+      DEFAULT_PERCENTILES);
+  printf("\t--format FORMAT 'text' (default), 'csv' with a header line or 'json'\n");
+  printf("\t   (JSON Lines), csv and json leave out the comments\n");
+  printf("\t--timer SOURCE 'monotonic' (default), 'monotonic_raw', 'tsc' (invariant\n");
+  printf("\t   TSC with rdtscp) or 'mpi' (MPI_Wtime) to time the kernels\n");
+  printf("\t--subtract-overhead take the measured cost of reading the timer off every time\n");
+  printf("\t--one-way synchronize the clocks before every message size and report the\n");
+  printf("\t   one-way latency from the start of the send to the end of the receive\n");
+  printf("\t   as rcv time, for the ring, send and single_trip modes\n");
+  printf("\t--trace FILE record every leg of every iteration and write them as Chrome\n");
+  printf("\t   trace JSON to FILE, for chrome://tracing or Perfetto\n");
+  printf("\t--trace-events N events kept per rank, older ones are dropped, default is %i\n",
+      TRACE_DEFAULT_EVENTS);
+  printf("\t--trace-align put the trace of all ranks on the timeline of rank 0, the\n");
+  printf("\t   clocks are synchronized before every message size like with --one-way\n");
+  printf("\t--fresh-buffers allocate a new message buffer for every iteration\n");
+  printf("\t--no-prefault don't touch the pre-allocated message buffers before the test\n");
+  printf("\t--window N messages in flight per iteration in send_bw, send_bibw\n");
+  printf("\t   and msg_rate, default is %u\n", mysettings.window);
+  printf("\t--pairs N largest number of concurrent pairs per node in msg_rate,\n");
+  printf("\t   which runs with 1, 2, 4, ... N pairs, default is all pairs\n");
+  printf("\t--threads N largest number of threads per rank in msg_rate_mt, which runs\n");
+  printf("\t   with 1, 2, 4, ... N threads under MPI_THREAD_MULTIPLE, default is %u\n",
+      mysettings.threads);
+  printf("\t--node-split also report the statistics of the legs whose peer is on the same\n");
+  printf("\t   node (intra) and on another node (inter) separately\n");
+  printf("\t--rma-sync SYNC 'fence' (default), 'lock' (MPI_Win_lock_all and MPI_Win_flush)\n");
+  printf("\t   or 'pscw' (post, start, complete, wait) for the rma modes\n");
+  printf("\t--rma-pair access the window of the even/odd partner instead of the next rank\n");
+  printf("\t--rma-ops N operations per epoch in the rma modes, default is %u\n",
+      mysettings.rma_ops);
+  printf("\t--dt-stride N stride in ints in the dt_* modes, default is %u\n",
+      mysettings.dt_stride);
+  printf("\t--verify check MAGIC_START, the tag, MAGIC_END and a CRC32C of the payload of\n");
+  printf("\t   every received message after the timed region and count the failures\n");
+  printf("\t   per message size (verify_fail), only for the round_trip*, dround_trip,\n");
+  printf("\t   send*, single_trip and msg_rate modes, the others don't carry the header\n");
+  printf("\t--matrix-bw with all_pairs also measure the bandwidth of every pair with\n");
+  printf("\t   --window streamed messages\n");
   printf("\tMODE can be 'round_trip','dround_trip', 'round_trip_msg_size', 'round_trip_wait' ,\
-      \n\t'round_trip_sync', 'send', 'round_trip_delay'\n");
+      \n\t'round_trip_sync', 'send', 'round_trip_delay', 'send_bw', 'send_bibw', 'msg_rate',\
+      \n\t'msg_rate_mt', 'rma_put', 'rma_get', 'rma_acc', 'round_trip_persist', 'send_persist',\
+      \n\t'dt_contig', 'dt_vector', 'dt_indexed', 'dt_subarray', 'dt_manual',\
+      \n\t'allreduce', 'bcast', 'reduce', 'allgather', 'alltoall', 'reduce_scatter', 'all_pairs'\n");
+  printf("\tround_trip_persist and send_persist are round_trip and send with persistent\n");
+  printf("\t   requests set up once per message size\n");
+  printf("\trma_put, rma_get and rma_acc time an access epoch with --rma-ops operations on\n");
+  printf("\t   the window of the next rank as snd and the same epoch without operations, the\n");
+  printf("\t   synchronization alone, as prb\n");
+  printf("\tdt_* send SIZE bytes of MPI_INT from every --dt-stride th int of a buffer from the\n");
+  printf("\t   even to the odd rank, as MPI_INT from a contiguous buffer (dt_contig), with a\n");
+  printf("\t   derived datatype or packed by hand (dt_manual), the packing and unpacking of\n");
+  printf("\t   dt_manual is the prb time and avg_pack_t and avg_unpack_t\n");
+  printf("\tall_pairs prints one row per rank with the median one-way latency (half the\n");
+  printf("\t   round trip) to every other rank, -e and -i don't apply to it\n");
   printf("\n");
   exit(EXIT_SUCCESS);
 }
 
+/* parse a size with an optional K, M or G suffix, returns -1 on error */
+int
+parse_size(const char *str, char **end, size_t *size)
+{
+  unsigned long long val;
+
+  if(*str < '0' || *str > '9')
+    return -1;
+  val = strtoull(str, end, 10);
+  if(val > MAX_MSG_SIZE)
+    return -1;
+  switch(**end) {
+    case 'G': case 'g':
+      val *= 1024;
+      /* fall through */
+    case 'M': case 'm':
+      val *= 1024;
+      /* fall through */
+    case 'K': case 'k':
+      val *= 1024;
+      (*end)++;
+      break;
+  }
+  if(val > MAX_MSG_SIZE)
+    return -1;
+  *size = val;
+  return 0;
+}
+
+int
+add_size(struct settings *mysettings, size_t size)
+{
+  size_t *sizes = realloc(mysettings->sizes,
+      (mysettings->nr_sizes + 1) * sizeof(size_t));
+  if(sizes == NULL)
+    return -1;
+  sizes[mysettings->nr_sizes++] = size;
+  mysettings->sizes = sizes;
+  return 0;
+}
+
+/* fill mysettings->sizes from a sweep specification, see usage() */
+int
+parse_sweep(struct settings *mysettings, const char *spec)
+{
+  size_t min, max, size, step = 0;
+  double factor = 0;
+  char *end;
+
+  free(mysettings->sizes);
+  mysettings->sizes = NULL;
+  mysettings->nr_sizes = 0;
+
+  if(strchr(spec, ':') == NULL) {
+    /* explicit list */
+    for(;;) {
+      if(parse_size(spec, &end, &size) != 0 || add_size(mysettings, size) != 0)
+        return -1;
+      if(*end == '\0')
+        return 0;
+      if(*end != ',')
+        return -1;
+      spec = end + 1;
+    }
+  }
+
+  if(parse_size(spec, &end, &min) != 0 || *end != ':')
+    return -1;
+  if(parse_size(end + 1, &end, &max) != 0 || max < min)
+    return -1;
+  if(*end == ':') {
+    end++;
+    if(*end == 'x' || *end == '*') {
+      factor = strtod(end + 1, &end);
+      if(factor <= 1.0)
+        return -1;
+    } else if(*end == '+') {
+      if(parse_size(end + 1, &end, &step) != 0 || step == 0)
+        return -1;
+    } else {
+      return -1;
+    }
+  }
+  if(*end != '\0')
+    return -1;
+
+  size = min;
+  for(;;) {
+    if(add_size(mysettings, size) != 0)
+      return -1;
+    size_t next;
+    if(step) {
+      next = size + step;
+    } else if(factor > 0) {
+      next = size * factor;
+      if(next <= size)
+        next = size + 1;
+    } else {
+      /* not only package size of 2 4 8, but 2 3 4 6 8 ... */
+      size_t pow2 = 1;
+      while(pow2 <= size)
+        pow2 *= 2;
+      next = (size == pow2 / 2 && size > 1) ? size + size / 2 : pow2;
+    }
+    if(next > max || next <= size)
+      break;
+    size = next;
+  }
+  return 0;
+}
+
+/* bandwidth in MB/s (10^6 bytes) for a message of size bytes taking ns nanoseconds */
+double
+bandwidth(size_t size, double ns)
+{
+  return ns > 0 ? size / ns * 1e3 : 0;
+}
+
+/* variance in s^2 from one in ns^2 */
+static inline double
+variance_sec(double variance_ns)
+{
+  return variance_ns / ((double) NSEC_PER_SEC * NSEC_PER_SEC);
+}
+
+/* comma separated list of percentiles, 0 < p <= 100 */
+int
+parse_percentiles(struct settings *mysettings, const char *list)
+{
+  char *end;
+
+  mysettings->nr_percentiles = 0;
+  for(;;) {
+    double p = strtod(list, &end);
+    if(end == list || p <= 0 || p > 100 ||
+       mysettings->nr_percentiles == MAX_PERCENTILES)
+      return -1;
+    mysettings->percentiles[mysettings->nr_percentiles++] = p;
+    if(*end == '\0')
+      return 0;
+    if(*end != ',')
+      return -1;
+    list = end + 1;
+  }
+}
+
+/*
+ * column names of the statistics of every rank, max_snd_t ... var_prb_t and
+ * then the percentiles of all legs, e.g. p99.9 -> p999_snd_t
+ */
+void
+column_names(const struct settings *mysettings, char names[][COLUMN_NAME_LEN])
+{
+  static const char *stat_names[5] = { "max", "min", "avg", "med", "var" };
+
+  for(unsigned int k = 0; k < 3; k++) {
+    for(unsigned int l = 0; l < 5; l++)
+      snprintf(names[5 * k + l], COLUMN_NAME_LEN, "%s_%s_t", stat_names[l], leg_names[k]);
+    for(unsigned int l = 0; l < mysettings->nr_percentiles; l++) {
+      char pct[COLUMN_NAME_LEN], *name = names[15 + k * mysettings->nr_percentiles + l];
+      unsigned int n = 0;
+      snprintf(pct, sizeof(pct), "%g", mysettings->percentiles[l]);
+      name[n++] = 'p';
+      for(char *c = pct; *c && n < COLUMN_NAME_LEN - 8; c++)
+        if(*c != '.')
+          name[n++] = *c;
+      snprintf(&name[n], COLUMN_NAME_LEN - n, "_%s_t", leg_names[k]);
+    }
+  }
+}
+
+/*
+ * Gather the snd, rcv and prb samples of all ranks on rank 0 and print
+ * one line per run, or one record per run and rank for csv and json. The runs are gathered in chunks which fit into
+ * mysettings->evolution_memory on rank 0, the next chunk is gathered
+ * while the current one is printed.
+ */
+void
+print_time_evolution(struct output *out, const struct settings *mysettings,
+		     size_t pkg_size, const uint64_t *times)
+{
+  const unsigned int nr_runs = mysettings->nr_runs;
+  /* two receive buffers of chunk runs of all ranks */
+  size_t chunk = mysettings->evolution_memory / (2 * 3 * sizeof(uint64_t) * world_size);
+  if(chunk > nr_runs)
+    chunk = nr_runs;
+  uint64_t *send_bf[2], *rcv_bf[2] = { NULL, NULL };
+  MPI_Request req[2];
+
+  for(unsigned int b = 0; b < 2; b++) {
+    send_bf[b] = calloc(3 * chunk, sizeof(uint64_t));
+    if(world_rank == 0)
+      rcv_bf[b] = malloc(3 * chunk * world_size * sizeof(uint64_t));
+    if(send_bf[b] == NULL || (world_rank == 0 && rcv_bf[b] == NULL)) {
+      fprintf(stderr, "Could not allocate %zu runs for the time evolution on rank %i\n",
+	      chunk, world_rank);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+  }
+
+  /* every chunk is gathered with the same count, the last one is padded */
+  unsigned int nr_chunks = (nr_runs + chunk - 1) / chunk;
+  for(unsigned int c = 0; c <= nr_chunks; c++) {
+    unsigned int b = c % 2;
+    if(c < nr_chunks) {
+      size_t first = c * chunk;
+      size_t n = nr_runs - first < chunk ? nr_runs - first : chunk;
+      for(unsigned int k = 0; k < 3; k++)
+        memcpy(&send_bf[b][k * chunk], &times[k * nr_runs + first], n * sizeof(uint64_t));
+      MPI_Igather(send_bf[b], 3 * chunk, MPI_UINT64_T,
+		  rcv_bf[b], 3 * chunk, MPI_UINT64_T,
+		  0, MPI_COMM_WORLD, &req[b]);
+    }
+    if(c == 0)
+      continue;
+    /* print the previous chunk while the current one is on its way */
+    unsigned int p = 1 - b;
+    MPI_Wait(&req[p], MPI_STATUS_IGNORE);
+    if(world_rank != 0)
+      continue;
+    size_t first = (c - 1) * chunk;
+    size_t n = nr_runs - first < chunk ? nr_runs - first : chunk;
+    for(size_t k = 0; k < n; k++) {
+      if(mysettings->format == output_text)
+        output_record_begin(out, mysettings->mode_name, pkg_size, -1);
+      for(int l = 0; l < world_size; l++) {
+        const uint64_t *rank_bf = &rcv_bf[p][3 * chunk * l];
+        if(mysettings->format != output_text) {
+          output_record_begin(out, mysettings->mode_name, pkg_size, l);
+          output_uint(out, "run", first + k);
+        }
+        output_time(out, "snd_t", rank_bf[k]);
+        output_time(out, "rcv_t", rank_bf[k + chunk]);
+        output_time(out, "prb_t", rank_bf[k + 2 * chunk]);
+        if(mysettings->format != output_text)
+          output_record_end(out);
+      }
+      if(mysettings->format == output_text)
+        output_record_end(out);
+    }
+  }
+
+  for(unsigned int b = 0; b < 2; b++) {
+    free(send_bf[b]);
+    free(rcv_bf[b]);
+  }
+}
+
+/*
+ * Collect the all_pairs rows on rank 0 one at a time and print them, row
+ * holds the latencies to all ranks followed by the stream times
+ */
+void
+print_pair_matrix(struct output *out, const struct settings *mysettings,
+		  size_t pkg_size, uint64_t *row, const int *node_of)
+{
+  const unsigned int nr_vals = (mysettings->matrix_bw ? 2 : 1) * world_size;
+  char name[COLUMN_NAME_LEN];
+
+  if(world_rank != 0) {
+    MPI_Send(row, nr_vals, MPI_UINT64_T, 0, MAGIC_ID, MPI_COMM_WORLD);
+    return;
+  }
+  output_text_header(out);
+  for(int i = 0; i < world_size; i++) {
+    if(i > 0)
+      MPI_Recv(row, nr_vals, MPI_UINT64_T, i, MAGIC_ID, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    output_record_begin(out, mysettings->mode_name, pkg_size, i);
+    for(int j = 0; j < world_size; j++) {
+      snprintf(name, sizeof(name), "lat_%i", j);
+      output_time(out, name, row[j]);
+    }
+    for(int j = 0; mysettings->matrix_bw && j < world_size; j++) {
+      snprintf(name, sizeof(name), "bw_%i", j);
+      output_double(out, name, bandwidth(pkg_size * mysettings->window, row[world_size + j]));
+    }
+    if(mysettings->node_split) {
+      /* mean over the pairs of this row within and across nodes */
+      double sum[2][2] = { { 0 } };
+      unsigned int n[2] = { 0 };
+      for(int j = 0; j < world_size; j++) {
+        if(j == i)
+          continue;
+        int c = node_of[j] == node_of[i] ? hop_intra : hop_inter;
+        sum[c][0] += row[j];
+        sum[c][1] += mysettings->matrix_bw ? row[world_size + j] : 0;
+        n[c]++;
+      }
+      for(unsigned int c = 0; c < 2; c++) {
+        snprintf(name, sizeof(name), "lat_%s", hop_names[c]);
+        output_time(out, name, n[c] ? sum[c][0] / n[c] : 0);
+      }
+      for(unsigned int c = 0; mysettings->matrix_bw && c < 2; c++) {
+        snprintf(name, sizeof(name), "bw_%s", hop_names[c]);
+        output_double(out, name, n[c] ? bandwidth(pkg_size * mysettings->window,
+            sum[c][1] / n[c]) : 0);
+      }
+    }
+    output_record_end(out);
+  }
+}
+
+/*
+ * the rank this rank sends to and the one it receives from in the point
+ * to point kernels, MPI_PROC_NULL if there is none, -1 for the modes
+ * without a single sender for every receive
+ */
+int
+hop_peers(enum run_mode mode, int *next, int *prev)
+{
+  switch(mode) {
+    case round_trip:
+    case dround_trip:
+    case round_trip_msg_size:
+    case round_trip_sync:
+    case round_trip_wait:
+    case round_trip_delay:
+    case round_trip_wait_recv:
+    case round_trip_persist:
+      *next = (world_rank + 1) % world_size;
+      *prev = (world_rank + world_size - 1) % world_size;
+      return 0;
+    case send:
+    case send_delay:
+    case send_persist:
+    case dt_contig_mode:
+    case dt_vector_mode:
+    case dt_indexed_mode:
+    case dt_subarray_mode:
+    case dt_manual_mode:
+      *next = world_rank % 2 == 0 ? world_rank + 1 : MPI_PROC_NULL;
+      *prev = world_rank % 2 != 0 ? world_rank - 1 : MPI_PROC_NULL;
+      return 0;
+    case single_trip:
+      *next = world_rank < world_size - 1 ? world_rank + 1 : MPI_PROC_NULL;
+      *prev = world_rank > 0 ? world_rank - 1 : MPI_PROC_NULL;
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+/*
+ * Run msg_rate_mt with nr_threads threads per rank and print the window
+ * times of all threads, the mean of the slowest thread and the message
+ * rate of all sending threads together
+ */
+void
+print_thread_rate(struct output *out, const struct settings *mysettings,
+		  size_t pkg_size, unsigned int nr_threads, struct stats *stats)
+{
+  struct stats *global = NULL;
+  double rate = 0, rate_gl = 0, slowest = 0, slowest_gl = 0;
+
+  if(thread_rate_run(pkg_size, nr_threads, mysettings->nr_runs, mysettings->window,
+		     mysettings->prefault, mysettings->fresh_buffers, stats) != 0) {
+    fprintf(stderr, "Could not run %u threads on rank %i\n", nr_threads, world_rank);
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
+  for(unsigned int t = 0; t < nr_threads; t++) {
+    double mean = stats_mean(&stats[t]);
+    if(mean > slowest)
+      slowest = mean;
+    if(world_rank % 2 == 0 && mean > 0)
+      rate += mysettings->window * (double) NSEC_PER_SEC / mean;
+    if(t > 0)
+      stats_merge(&stats[0], &stats[t]);
+  }
+  if(world_rank == 0)
+    global = malloc(sizeof(struct stats));
+  stats_reduce(stats, global, 1, 0, MPI_COMM_WORLD);
+  MPI_Reduce(&rate, &rate_gl, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  MPI_Reduce(&slowest, &slowest_gl, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  if(world_rank != 0)
+    return;
+
+  output_text_header(out);
+  output_record_begin(out, mysettings->mode_name, pkg_size, -1);
+  output_uint(out, "threads", nr_threads);
+  output_time(out, "max_t", global->max);
+  output_time(out, "min_t", global->min);
+  output_time(out, "avg_t", stats_mean(global));
+  output_time(out, "med_t", stats_percentile(global, 50));
+  output_time(out, "max_thread_avg_t", slowest_gl);
+  output_double(out, "msg_rate", rate_gl);
+  output_double(out, "msg_rate_thread", rate_gl / (nr_threads * (world_size / 2)));
+  output_double(out, "bw", rate_gl * pkg_size / 1e6);
+  output_record_end(out);
+  free(global);
+}
+
+/*
+ * One "host: ranks" comment per node with the ranks as ranges, e.g.
+ * "node1: 0-63 128-191". Only the first rank of every node sends its
+ * processor name to rank 0, the ranks of the nodes are taken from
+ * node_of, so nothing is quadratic in the number of ranks.
+ */
+void
+print_host_map(struct output *out, const int *node_of, const char *processor_name)
+{
+  MPI_Comm leader_comm;
+  int nr_nodes, node = 0;
+  char *names = NULL;
+
+  MPI_Comm_split(MPI_COMM_WORLD, node_of[world_rank] == world_rank ? 0 : MPI_UNDEFINED,
+      world_rank, &leader_comm);
+  if(leader_comm == MPI_COMM_NULL)
+    return;
+  MPI_Comm_size(leader_comm, &nr_nodes);
+  if(world_rank == 0)
+    names = malloc((size_t) nr_nodes * MPI_MAX_PROCESSOR_NAME);
+  MPI_Gather(processor_name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR,
+	     names, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, 0, leader_comm);
+  MPI_Comm_free(&leader_comm);
+  if(world_rank != 0)
+    return;
+
+  /* room for every rank number */
+  char *host_line = malloc(MPI_MAX_PROCESSOR_NAME + 12 * world_size);
+  /* ranks chained per node in rank order, the node's first rank leads */
+  int *next_on_node = malloc(2 * world_size * sizeof(int));
+  int *last_on_node = next_on_node + world_size;
+  for(int i = 0; i < world_size; i++) {
+    next_on_node[i] = -1;
+    if(node_of[i] != i)
+      next_on_node[last_on_node[node_of[i]]] = i;
+    last_on_node[node_of[i]] = i;
+  }
+  /* the leaders are in rank order in leader_comm too */
+  for(int i = 0; i < world_size; i++) {
+    if(node_of[i] != i)
+      continue;
+    char *name = &names[(size_t) MPI_MAX_PROCESSOR_NAME * node++];
+    name[MPI_MAX_PROCESSOR_NAME - 1] = '\0';
+    int len = sprintf(host_line, "%s:", name);
+    for(int j = i; j >= 0; j = next_on_node[j]) {
+      int first = j;
+      while(next_on_node[j] == j + 1)
+        j++;
+      if(j == first)
+        len += sprintf(host_line + len, " %i", j);
+      else
+        len += sprintf(host_line + len, " %i-%i", first, j);
+    }
+    output_comment(out, "%s", host_line);
+  }
+  free(next_on_node);
+  free(host_line);
+  free(names);
+}
+
+/* layout of a datatype mode, -1 for the other modes */
+static inline int
+dt_mode_layout(enum run_mode mode)
+{
+  switch(mode) {
+    case dt_contig_mode:
+      return dt_contig;
+    case dt_vector_mode:
+      return dt_vector;
+    case dt_indexed_mode:
+      return dt_indexed;
+    case dt_subarray_mode:
+      return dt_subarray;
+    case dt_manual_mode:
+      return dt_manual;
+    default:
+      return -1;
+  }
+}
+
+static inline int
+is_rma(enum run_mode mode)
+{
+  return mode == rma_put || mode == rma_get || mode == rma_acc;
+}
+
+static inline int
+is_collective(enum run_mode mode)
+{
+  return mode == allreduce || mode == bcast || mode == reduce ||
+    mode == allgather || mode == alltoall || mode == reduce_scatter;
+}
+
+/*
+ * whether the kernel of a mode checks the received messages with --verify,
+ * the dt_*, rma_*, collective, all_pairs and msg_rate_mt kernels don't
+ */
+static inline int
+has_verify(enum run_mode mode)
+{
+  switch(mode) {
+    case round_trip:
+    case round_trip_total:
+    case dround_trip:
+    case round_trip_msg_size:
+    case round_trip_wait:
+    case round_trip_sync:
+    case round_trip_delay:
+    case send:
+    case send_delay:
+    case single_trip:
+    case round_trip_wait_recv:
+    case round_trip_persist:
+    case send_persist:
+    case send_bw:
+    case send_bibw:
+    case msg_rate:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/* the rank whose window this rank accesses and the one accessing its window */
+void
+rma_peers(const struct settings *mysettings, int *target, int *origin)
+{
+  if(mysettings->rma_pair) {
+    *target = *origin = world_rank ^ 1;
+  } else {
+    *target = (world_rank + 1) % world_size;
+    *origin = (world_rank + world_size - 1) % world_size;
+  }
+}
+
+/* the peer of the snd and of the rcv and prb legs, -1 if there is none */
+void
+leg_peers(const struct settings *mysettings, int peer[3])
+{
+  enum run_mode mode = mysettings->mode;
+  int next, prev;
+
+  peer[leg_snd] = peer[leg_rcv] = peer[leg_prb] = -1;
+  if(is_rma(mode)) {
+    rma_peers(mysettings, &next, &prev);
+    peer[leg_snd] = peer[leg_prb] = next;
+  } else if(hop_peers(mode, &next, &prev) == 0) {
+    peer[leg_snd] = next;
+    peer[leg_rcv] = peer[leg_prb] = prev;
+  } else if(mode == send_bw || mode == send_bibw || mode == msg_rate) {
+    peer[leg_snd] = peer[leg_rcv] = world_rank ^ 1;
+  }
+  for(unsigned int k = 0; k < 3; k++)
+    if(peer[k] == MPI_PROC_NULL)
+      peer[k] = -1;
+}
+
+/* whether peer is on the node of this rank */
+static inline enum hop_class
+hop_class(const int *node_of, int peer)
+{
+  if(peer < 0)
+    return hop_none;
+  return node_of[peer] == node_of[world_rank] ? hop_intra : hop_inter;
+}
+
 struct settings
 parse_cmdline(int argc,char** argv)
 {
   struct settings mysettings;
   int opt = 0;
+  char *end;
 
   mysettings.nr_runs = 1000;
   mysettings.fill_random = 0;
   mysettings.mode = round_trip;
+  mysettings.mode_name = "round_trip";
+  mysettings.evolution_file = NULL;
+  parse_size(DEFAULT_EVOLUTION_MEMORY, &end, &mysettings.evolution_memory);
   mysettings.wait = 20;
   mysettings.time_evolution = 0;
   mysettings.by_rank = 0;
+  mysettings.fresh_buffers = 0;
+  mysettings.prefault = 1;
+  mysettings.window = 64;
+  mysettings.pairs = 0;
+  mysettings.threads = 4;
+  mysettings.online = 0;
+  mysettings.format = output_text;
+  mysettings.timer_source = timer_monotonic;
+  mysettings.subtract_overhead = 0;
+  mysettings.one_way = 0;
+  mysettings.trace_file = NULL;
+  mysettings.trace_events = TRACE_DEFAULT_EVENTS;
+  mysettings.trace_align = 0;
+  mysettings.matrix_bw = 0;
+  mysettings.node_split = 0;
+  mysettings.rma_sync = rma_fence;
+  mysettings.rma_pair = 0;
+  mysettings.rma_ops = 1;
+  mysettings.dt_stride = 2;
+  mysettings.verify = 0;
+  parse_percentiles(&mysettings, DEFAULT_PERCENTILES);
+  mysettings.sizes = NULL;
+  mysettings.nr_sizes = 0;
 
   srand(42);
 
-  while((opt = getopt(argc,argv,"rhs:t:w:e")) != -1 ) {
+  enum {
+    opt_fresh_buffers = 256,
+    opt_no_prefault,
+    opt_window,
+    opt_pairs,
+    opt_threads,
+    opt_online,
+    opt_percentiles,
+    opt_evolution_memory,
+    opt_format,
+    opt_timer,
+    opt_subtract_overhead,
+    opt_one_way,
+    opt_trace,
+    opt_trace_events,
+    opt_trace_align,
+    opt_matrix_bw,
+    opt_node_split,
+    opt_rma_sync,
+    opt_rma_pair,
+    opt_rma_ops,
+    opt_dt_stride,
+    opt_verify,
+  };
+  static const struct option long_options[] = {
+    {"fresh-buffers", no_argument, NULL, opt_fresh_buffers},
+    {"no-prefault", no_argument, NULL, opt_no_prefault},
+    {"window", required_argument, NULL, opt_window},
+    {"pairs", required_argument, NULL, opt_pairs},
+    {"threads", required_argument, NULL, opt_threads},
+    {"online", no_argument, NULL, opt_online},
+    {"percentiles", required_argument, NULL, opt_percentiles},
+    {"evolution-file", required_argument, NULL, 'E'},
+    {"evolution-memory", required_argument, NULL, opt_evolution_memory},
+    {"format", required_argument, NULL, opt_format},
+    {"timer", required_argument, NULL, opt_timer},
+    {"subtract-overhead", no_argument, NULL, opt_subtract_overhead},
+    {"one-way", no_argument, NULL, opt_one_way},
+    {"trace", required_argument, NULL, opt_trace},
+    {"trace-events", required_argument, NULL, opt_trace_events},
+    {"trace-align", no_argument, NULL, opt_trace_align},
+    {"matrix-bw", no_argument, NULL, opt_matrix_bw},
+    {"node-split", no_argument, NULL, opt_node_split},
+    {"rma-sync", required_argument, NULL, opt_rma_sync},
+    {"rma-pair", no_argument, NULL, opt_rma_pair},
+    {"rma-ops", required_argument, NULL, opt_rma_ops},
+    {"dt-stride", required_argument, NULL, opt_dt_stride},
+    {"verify", no_argument, NULL, opt_verify},
+    {NULL, 0, NULL, 0}
+  };
+
+  while((opt = getopt_long(argc,argv,"rhs:t:w:eE:im:",long_options,NULL)) != -1 ) {
     switch(opt) {
       case 'r':
         mysettings.fill_random = 1;
@@ -128,16 +908,122 @@ parse_cmdline(int argc,char** argv)
       case 'e':
         mysettings.time_evolution = 1;
         break;
+      case 'E':
+        mysettings.time_evolution = 1;
+        mysettings.evolution_file = optarg;
+        break;
+      case 'm':
+        if(parse_sweep(&mysettings, optarg) != 0) {
+          fprintf(stderr, "Invalid message sizes '%s', sizes are limited to %zu bytes\n",
+              optarg, MAX_MSG_SIZE);
+          exit(EXIT_FAILURE);
+        }
+        break;
       case 'i':
         mysettings.by_rank = 1;
         break;
+      case opt_fresh_buffers:
+        mysettings.fresh_buffers = 1;
+        break;
+      case opt_no_prefault:
+        mysettings.prefault = 0;
+        break;
+      case opt_window:
+        mysettings.window = atoi(optarg);
+        if(mysettings.window == 0)
+          mysettings.window = 1;
+        break;
+      case opt_pairs:
+        mysettings.pairs = atoi(optarg);
+        break;
+      case opt_threads:
+        mysettings.threads = atoi(optarg);
+        if(mysettings.threads == 0)
+          mysettings.threads = 1;
+        break;
+      case opt_online:
+        mysettings.online = 1;
+        break;
+      case opt_percentiles:
+        if(parse_percentiles(&mysettings, optarg) != 0) {
+          fprintf(stderr, "Invalid percentiles '%s', at most %i in (0,100] are possible\n",
+              optarg, MAX_PERCENTILES);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case opt_evolution_memory:
+        if(parse_size(optarg, &end, &mysettings.evolution_memory) != 0 || *end != '\0') {
+          fprintf(stderr, "Invalid memory budget '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case opt_format:
+        if(output_parse_format(optarg, &mysettings.format) != 0) {
+          fprintf(stderr, "Invalid output format '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case opt_timer:
+        if(timer_parse_source(optarg, &mysettings.timer_source) != 0) {
+          fprintf(stderr, "Invalid timer '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case opt_subtract_overhead:
+        mysettings.subtract_overhead = 1;
+        break;
+      case opt_one_way:
+        mysettings.one_way = 1;
+        break;
+      case opt_trace:
+        mysettings.trace_file = optarg;
+        break;
+      case opt_trace_events:
+        mysettings.trace_events = strtoull(optarg, NULL, 10);
+        break;
+      case opt_trace_align:
+        mysettings.trace_align = 1;
+        break;
+      case opt_matrix_bw:
+        mysettings.matrix_bw = 1;
+        break;
+      case opt_node_split:
+        mysettings.node_split = 1;
+        break;
+      case opt_rma_sync:
+        if(rma_parse_sync(optarg, &mysettings.rma_sync) != 0) {
+          fprintf(stderr, "Invalid RMA synchronization '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case opt_rma_pair:
+        mysettings.rma_pair = 1;
+        break;
+      case opt_rma_ops:
+        mysettings.rma_ops = atoi(optarg);
+        if(mysettings.rma_ops == 0)
+          mysettings.rma_ops = 1;
+        break;
+      case opt_dt_stride:
+        mysettings.dt_stride = atoi(optarg);
+        if(mysettings.dt_stride == 0)
+          mysettings.dt_stride = 1;
+        break;
+      case opt_verify:
+        mysettings.verify = 1;
+        break;
     }
   }
 
+  if(mysettings.sizes == NULL && parse_sweep(&mysettings, DEFAULT_SWEEP) != 0) {
+    fprintf(stderr, "Could not allocate message sizes\n");
+    exit(EXIT_FAILURE);
+  }
+
   for(; optind < argc; optind++){ //when some extra arguments are passed
     if (strcmp("round_trip",argv[optind]) == 0)
       mysettings.mode = round_trip;
-    if (strcmp("round_trip_total",argv[optind]) == 0)
+    else if (strcmp("round_trip_total",argv[optind]) == 0)
       mysettings.mode = round_trip_total;
     else if (strcmp("dround_trip",argv[optind]) == 0)
       mysettings.mode = dround_trip;
@@ -157,8 +1043,90 @@ parse_cmdline(int argc,char** argv)
       mysettings.mode = single_trip;
     else if (strcmp("round_trip_wait_recv",argv[optind]) == 0)
       mysettings.mode = round_trip_wait_recv;
+    else if (strcmp("round_trip_persist",argv[optind]) == 0)
+      mysettings.mode = round_trip_persist;
+    else if (strcmp("send_persist",argv[optind]) == 0)
+      mysettings.mode = send_persist;
+    else if (strcmp("send_bw",argv[optind]) == 0)
+      mysettings.mode = send_bw;
+    else if (strcmp("send_bibw",argv[optind]) == 0)
+      mysettings.mode = send_bibw;
+    else if (strcmp("msg_rate",argv[optind]) == 0)
+      mysettings.mode = msg_rate;
+    else if (strcmp("msg_rate_mt",argv[optind]) == 0)
+      mysettings.mode = msg_rate_mt;
+    else if (strcmp("allreduce",argv[optind]) == 0)
+      mysettings.mode = allreduce;
+    else if (strcmp("bcast",argv[optind]) == 0)
+      mysettings.mode = bcast;
+    else if (strcmp("reduce",argv[optind]) == 0)
+      mysettings.mode = reduce;
+    else if (strcmp("allgather",argv[optind]) == 0)
+      mysettings.mode = allgather;
+    else if (strcmp("alltoall",argv[optind]) == 0)
+      mysettings.mode = alltoall;
+    else if (strcmp("reduce_scatter",argv[optind]) == 0)
+      mysettings.mode = reduce_scatter;
+    else if (strcmp("all_pairs",argv[optind]) == 0)
+      mysettings.mode = all_pairs;
+    else if (strcmp("rma_put",argv[optind]) == 0)
+      mysettings.mode = rma_put;
+    else if (strcmp("rma_get",argv[optind]) == 0)
+      mysettings.mode = rma_get;
+    else if (strcmp("rma_acc",argv[optind]) == 0)
+      mysettings.mode = rma_acc;
+    else if (strcmp("dt_contig",argv[optind]) == 0)
+      mysettings.mode = dt_contig_mode;
+    else if (strcmp("dt_vector",argv[optind]) == 0)
+      mysettings.mode = dt_vector_mode;
+    else if (strcmp("dt_indexed",argv[optind]) == 0)
+      mysettings.mode = dt_indexed_mode;
+    else if (strcmp("dt_subarray",argv[optind]) == 0)
+      mysettings.mode = dt_subarray_mode;
+    else if (strcmp("dt_manual",argv[optind]) == 0)
+      mysettings.mode = dt_manual_mode;
     else
       usage(mysettings);
+    mysettings.mode_name = argv[optind];
+  }
+  if(mysettings.fresh_buffers &&
+     (mysettings.mode == round_trip_persist || mysettings.mode == send_persist)) {
+    fprintf(stderr, "Persistent requests need the same buffer, --fresh-buffers isn't possible\n");
+    exit(EXIT_FAILURE);
+  }
+  for(unsigned int i = 0; is_collective(mysettings.mode) && i < mysettings.nr_sizes; i++) {
+    if(mysettings.sizes[i] < sizeof(int)) {
+      fprintf(stderr, "The collectives send MPI_INT, sizes below %zu bytes aren't possible\n",
+          sizeof(int));
+      exit(EXIT_FAILURE);
+    }
+  }
+  for(unsigned int i = 0; mysettings.mode == rma_acc && i < mysettings.nr_sizes; i++) {
+    if(mysettings.sizes[i] < sizeof(int) || mysettings.sizes[i] % sizeof(int) != 0) {
+      fprintf(stderr, "rma_acc accumulates MPI_INT, sizes have to be multiples of %zu bytes\n",
+          sizeof(int));
+      exit(EXIT_FAILURE);
+    }
+  }
+  for(unsigned int i = 0; dt_mode_layout(mysettings.mode) >= 0 && i < mysettings.nr_sizes; i++) {
+    if(mysettings.sizes[i] < sizeof(int) || mysettings.sizes[i] % sizeof(int) != 0) {
+      fprintf(stderr, "The dt_* modes send MPI_INT, sizes have to be multiples of %zu bytes\n",
+          sizeof(int));
+      exit(EXIT_FAILURE);
+    }
+  }
+  if(mysettings.mode == msg_rate_mt && (mysettings.time_evolution || mysettings.by_rank)) {
+    fprintf(stderr, "msg_rate_mt only prints global statistics, -e, -E and -i aren't possible\n");
+    exit(EXIT_FAILURE);
+  }
+  if(mysettings.fresh_buffers && dt_mode_layout(mysettings.mode) >= 0) {
+    fprintf(stderr, "The dt_* modes keep their buffers, --fresh-buffers isn't possible\n");
+    exit(EXIT_FAILURE);
+  }
+  if(mysettings.verify && !has_verify(mysettings.mode)) {
+    fprintf(stderr, "--verify is only possible with the round_trip*, dround_trip, send*,\n"
+        "single_trip and msg_rate modes\n");
+    exit(EXIT_FAILURE);
   }
   return mysettings;
 }
@@ -170,11 +1138,26 @@ main(int argc, char** argv) {
   char processor_name[MPI_MAX_PROCESSOR_NAME];
   int name_len;
   long* send_bf_init = malloc(2*sizeof(long));
+  struct output out;
+  char col_names[MAX_RANK_VALS][COLUMN_NAME_LEN];
+
+  if(output_init(&out, mysettings.format) != 0) {
+    fprintf(stderr, "Could not allocate the output buffer\n");
+    exit(EXIT_FAILURE);
+  }
+  column_names(&mysettings, col_names);
+  msg_verify.enabled = mysettings.verify;
+  if(msg_verify.enabled)
+    checksum_init();
 
   clock_gettime(CLOCK_MONOTONIC, &time_gl_start);
 
   clock_gettime(CLOCK_MONOTONIC, &time_start);
-  MPI_Init(&argc,&argv);
+  int thread_level = MPI_THREAD_SINGLE;
+  if(mysettings.mode == msg_rate_mt)
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_level);
+  else
+    MPI_Init(&argc,&argv);
   clock_gettime(CLOCK_MONOTONIC, &time_end);
 
   // Get the number of processes
@@ -182,6 +1165,36 @@ main(int argc, char** argv) {
   MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
   MPI_Get_processor_name(processor_name, &name_len);
 
+  /* two receive buffers of at least one run of all ranks */
+  if(mysettings.time_evolution && mysettings.evolution_file == NULL &&
+     mysettings.evolution_memory < 2 * 3 * sizeof(uint64_t) * world_size) {
+    if(world_rank == 0)
+      fprintf(stderr, "--evolution-memory needs at least %zu bytes for %i ranks\n",
+          2 * 3 * sizeof(uint64_t) * world_size, world_size);
+    MPI_Finalize();
+    exit(EXIT_FAILURE);
+  }
+  if(is_rma(mysettings.mode) && mysettings.rma_pair && world_size % 2 != 0) {
+    if(world_rank == 0)
+      fprintf(stderr, "--rma-pair needs an even number of ranks\n");
+    MPI_Finalize();
+    exit(EXIT_FAILURE);
+  }
+  if(mysettings.mode == msg_rate_mt &&
+     (thread_level < MPI_THREAD_MULTIPLE || world_size % 2 != 0)) {
+    if(world_rank == 0)
+      fprintf(stderr, "msg_rate_mt needs MPI_THREAD_MULTIPLE and an even number of ranks\n");
+    MPI_Finalize();
+    exit(EXIT_FAILURE);
+  }
+
+  if(timer_init(mysettings.timer_source, mysettings.subtract_overhead) != 0) {
+    fprintf(stderr, "Timer %s is not usable on rank %i\n", timer.name, world_rank);
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
+
+  int *node_of = node_map();
+
   /* start with time which was needed for init and some more general information*/
   tlog_timespec_sub(&time_end,&time_start,&time_diff);
   send_bf_init[0] = time_diff.tv_sec;
@@ -191,114 +1204,342 @@ main(int argc, char** argv) {
     int mpi_version_len = 0;
     char mpi_version[MPI_MAX_LIBRARY_VERSION_STRING];
     long *recv_bf_init = malloc(2*world_size*sizeof(long));
-    char *recv_bf_proc = malloc(world_size*sizeof(char)*MPI_MAX_PROCESSOR_NAME);
 
     MPI_Get_library_version(mpi_version,&mpi_version_len);
-    printf("# MPI version: %s\n",mpi_version);
-    printf("# Nr of processors are: %i\n",world_size);
+    output_comment(&out, "MPI version: %s", mpi_version);
+    output_comment(&out, "Nr of processors are: %i", world_size);
+    output_comment(&out, "Timer: %s, %g ns per tick, resolution %g ns, overhead %g ns%s",
+		   timer.name, timer.ns_per_tick, timer.resolution, timer.overhead,
+		   timer.subtract ? " (subtracted)" : "");
 
     MPI_Gather(send_bf_init, 2, MPI_LONG,
 	       recv_bf_init, 2, MPI_LONG,
 	       0, MPI_COMM_WORLD);
     /* get the processor (node) names and print them out */
-    MPI_Gather(processor_name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR,
-	       recv_bf_proc, MPI_MAX_PROCESSOR_NAME, MPI_CHAR,
-	       0, MPI_COMM_WORLD);
-
-    for(unsigned int i = 0; i < (unsigned int) world_size; i++) {
-      char temp_str[MPI_MAX_PROCESSOR_NAME];
-      strncpy(temp_str, &recv_bf_proc[MPI_MAX_PROCESSOR_NAME*i], MPI_MAX_PROCESSOR_NAME);
-      if(strlen(temp_str) > 0) {
-        printf("# %s:", temp_str);
-        for(unsigned int j = i; j < (unsigned int) world_size; j++) {
-          if(strcmp(temp_str, &recv_bf_proc[MPI_MAX_PROCESSOR_NAME*j])== 0) {
-            printf(" %i",j);
-            memset(&recv_bf_proc[MPI_MAX_PROCESSOR_NAME*j],'\0',MPI_MAX_PROCESSOR_NAME);
-          }
-        }
-        printf("\n");
-      }
-    }
+    print_host_map(&out, node_of, processor_name);
 
-    printf("# MPI_Init times for ranks\n");
+    output_comment(&out, "MPI_Init times for ranks");
     for(unsigned int i = 0; i < (unsigned int) world_size; i++) {
-      printf("# %lu.%lu\n", recv_bf_init[2*i], recv_bf_init[2*i+1]);
+      output_comment(&out, "%lu.%lu", recv_bf_init[2*i], recv_bf_init[2*i+1]);
     }
 
     free(recv_bf_init);
-    free(recv_bf_proc);
   } else {
     MPI_Gather(send_bf_init, 2, MPI_LONG,
 	       NULL, 2, MPI_LONG,
 	       0, MPI_COMM_WORLD);
-    MPI_Gather(processor_name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR,
-	       NULL, MPI_MAX_PROCESSOR_NAME, MPI_CHAR,
-	       0, MPI_COMM_WORLD);
+    print_host_map(&out, node_of, processor_name);
   }
   free(send_bf_init);
 
-  unsigned int pkg_size = 2, msg_count = 0;
-  for(unsigned int i = 4; i <= 14;) {
-    /* not only package size of 2 4 8, but 2 3 4 6 8 ... */
-      if(pkg_size <(unsigned int) int_pow(2,i) ) {
-        pkg_size = int_pow(2,i);
-      } else {
-        pkg_size += int_pow(2,i+1);
-        pkg_size /= 2;
-        i++;
+  /*
+   * msg_rate steps through 1, 2, 4, ... max_pairs concurrent pairs per
+   * size, msg_rate_mt through the threads per rank the same way
+   */
+  unsigned int pair_index = 0, max_pairs = 1, nr_pair_steps = 1;
+  struct stats *thread_stats = NULL;
+  if(mysettings.mode == msg_rate) {
+    pair_index = node_pair_index(&max_pairs);
+    if(mysettings.pairs > 0 && mysettings.pairs < max_pairs)
+      max_pairs = mysettings.pairs;
+  } else if(mysettings.mode == msg_rate_mt) {
+    max_pairs = mysettings.threads;
+    thread_stats = malloc(max_pairs * sizeof(struct stats));
+    if(thread_stats == NULL || thread_rate_init(max_pairs) != 0) {
+      fprintf(stderr, "Could not set up %u threads on rank %i\n", max_pairs, world_rank);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+  }
+  while((1u << (nr_pair_steps - 1)) < max_pairs)
+    nr_pair_steps++;
+
+  /* the time evolution and the exact per-rank statistics need every sample */
+  unsigned int online = !mysettings.time_evolution &&
+    (mysettings.online || !mysettings.by_rank);
+  /* always kept, the global percentiles are merged from them */
+  struct stats *run_stats = malloc(3 * sizeof(struct stats));
+  /*
+   * snd, rcv and prb samples in ns back to back, the layout of the -e
+   * gather, allocated once and reused for every message size
+   */
+  uint64_t *times = NULL;
+  if(!online) {
+    times = malloc(3 * mysettings.nr_runs * sizeof(uint64_t));
+    if(times == NULL) {
+      fprintf(stderr, "Could not allocate %u samples on rank %i\n",
+	      3 * mysettings.nr_runs, world_rank);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+  }
+  uint64_t *times_snd = times, *times_rcv = NULL, *times_prb = NULL;
+  if(times) {
+    times_rcv = times + mysettings.nr_runs;
+    times_prb = times + 2 * mysettings.nr_runs;
+  }
+
+  /*
+   * send start and receive end of the last hop_chunk runs on the common
+   * timeline, and the send starts of the rank which sends to this one
+   */
+  uint64_t *hop_snd = NULL, *hop_rcv = NULL, *hop_prev = NULL;
+  int hop_next = MPI_PROC_NULL, hop_prev_rank = MPI_PROC_NULL;
+  const unsigned int hop_chunk = mysettings.nr_runs < ONE_WAY_CHUNK ?
+    mysettings.nr_runs : ONE_WAY_CHUNK;
+  if(mysettings.one_way) {
+    if(hop_peers(mysettings.mode, &hop_next, &hop_prev_rank) != 0) {
+      if(world_rank == 0)
+        fprintf(stderr, "--one-way is not possible with mode %s\n", mysettings.mode_name);
+      MPI_Finalize();
+      exit(EXIT_FAILURE);
+    }
+    hop_snd = calloc(3 * hop_chunk, sizeof(uint64_t));
+    if(hop_snd == NULL) {
+      fprintf(stderr, "Could not allocate %u time stamps on rank %i\n",
+	      3 * hop_chunk, world_rank);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    hop_rcv = hop_snd + hop_chunk;
+    hop_prev = hop_snd + 2 * hop_chunk;
+    if(world_rank == 0)
+      output_comment(&out, "rcv times are one-way latencies on the timeline of rank 0");
+  }
+
+  /* the peer of every leg and whether it is on the same node */
+  int peer[3];
+  enum hop_class leg_class[3];
+  leg_peers(&mysettings, peer);
+  for(unsigned int k = 0; k < 3; k++)
+    leg_class[k] = hop_class(node_of, peer[k]);
+
+  /* the run statistics of every leg sorted by hop class */
+  struct stats *split_stats = NULL;
+  if(mysettings.node_split) {
+    split_stats = malloc(2 * 3 * sizeof(struct stats));
+    if(split_stats == NULL) {
+      fprintf(stderr, "Could not allocate the node split statistics on rank %i\n", world_rank);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+  }
+
+  struct trace trace = { NULL, 0, 0 };
+  if(mysettings.trace_file && trace_init(&trace, mysettings.trace_events) != 0) {
+    fprintf(stderr, "Could not allocate %zu trace events on rank %i\n",
+	    mysettings.trace_events, world_rank);
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
+
+  /* this rank's row of the all_pairs matrices, also the receive buffer of rank 0 */
+  uint64_t *matrix_row = NULL;
+  if(mysettings.mode == all_pairs) {
+    matrix_row = calloc(2 * world_size, sizeof(uint64_t));
+    if(matrix_row == NULL) {
+      fprintf(stderr, "Could not allocate the matrix row on rank %i\n", world_rank);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    if(world_rank == 0)
+      output_comment(&out, "%i ranks in %i rounds of disjoint pairs", world_size,
+		     pair_nr_rounds(world_size));
+  }
+
+  struct sample_file *evolution_file = NULL;
+  if(mysettings.evolution_file) {
+    size_t *step_sizes = malloc(mysettings.nr_sizes * nr_pair_steps * sizeof(size_t));
+    for(unsigned int step = 0; step < mysettings.nr_sizes * nr_pair_steps; step++)
+      step_sizes[step] = mysettings.sizes[step / nr_pair_steps];
+    evolution_file = sample_file_open(mysettings.evolution_file, mysettings.mode_name,
+        step_sizes, mysettings.nr_sizes * nr_pair_steps, mysettings.nr_runs, processor_name);
+    free(step_sizes);
+    if(evolution_file == NULL) {
+      fprintf(stderr, "Could not open %s on rank %i\n", mysettings.evolution_file, world_rank);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+  }
+
+  unsigned int msg_count = 0;
+  for(unsigned int step = 0; step < mysettings.nr_sizes * nr_pair_steps; step++) {
+    size_t pkg_size = mysettings.sizes[step / nr_pair_steps];
+    unsigned int pairs = 1u << (step % nr_pair_steps);
+    if(pairs > max_pairs)
+      pairs = max_pairs;
+    /* bytes moved per iteration, for the bandwidth */
+    size_t iter_size = pkg_size;
+    if(mysettings.mode == send_bw || mysettings.mode == send_bibw ||
+       mysettings.mode == msg_rate)
+      iter_size *= mysettings.window;
+    if(is_rma(mysettings.mode))
+      iter_size *= mysettings.rma_ops;
+    if(mysettings.mode == msg_rate_mt) {
+      print_thread_rate(&out, &mysettings, pkg_size, pairs, thread_stats);
+      output_flush(&out);
+      continue;
+    }
+    /* the datatype modes have their own buffers */
+    struct msg_buf buf = { 0 };
+    if(dt_mode_layout(mysettings.mode) < 0 &&
+       msg_buf_init(&buf, pkg_size, mysettings.prefault, mysettings.fresh_buffers) != 0) {
+      fprintf(stderr,"Could not allocate message buffer of size %zu on rank %i\n",
+	      pkg_size, world_rank);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    if(mysettings.mode == all_pairs) {
+      pair_matrix_row(&buf, mysettings.nr_runs, mysettings.window, matrix_row,
+          mysettings.matrix_bw ? matrix_row + world_size : NULL);
+      msg_buf_free(&buf);
+      print_pair_matrix(&out, &mysettings, pkg_size, matrix_row, node_of);
+      output_flush(&out);
+      continue;
+    }
+    if(mysettings.mode == round_trip_persist || mysettings.mode == send_persist) {
+      int next, prev;
+      hop_peers(mysettings.mode, &next, &prev);
+      if(msg_buf_persist(&buf, next, prev, MAGIC_ID) != 0) {
+        fprintf(stderr, "Could not set up the persistent requests on rank %i\n", world_rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+      }
+    }
+    struct dt_msg dt;
+    if(dt_mode_layout(mysettings.mode) >= 0 &&
+       dt_msg_init(&dt, pkg_size, mysettings.dt_stride, dt_mode_layout(mysettings.mode),
+		   mysettings.prefault) != 0) {
+      fprintf(stderr, "Could not set up the datatype of size %zu with stride %u on rank %i\n",
+	      pkg_size, mysettings.dt_stride, world_rank);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
     }
-    double *times_snd = calloc(mysettings.nr_runs,sizeof(double));
-    double *times_rcv = calloc(mysettings.nr_runs,sizeof(double));
-    double *times_prb = calloc(mysettings.nr_runs,sizeof(double));
+    struct rma_win win;
+    if(is_rma(mysettings.mode)) {
+      int target, origin;
+      rma_peers(&mysettings, &target, &origin);
+      if(rma_win_init(&win, pkg_size * mysettings.rma_ops, target, origin,
+		      mysettings.rma_sync) != MPI_SUCCESS) {
+        fprintf(stderr, "Could not allocate a window of size %zu on rank %i\n",
+		pkg_size * mysettings.rma_ops, world_rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+      }
+    }
+    for(unsigned int k = 0; k < 3; k++)
+      stats_init(&run_stats[k]);
+    /* samples of the legs this rank took part in, the others stay 0 in -e */
+    unsigned int nr_samples[3] = { 0, 0, 0 };
+    if(times)
+      memset(times, 0, 3 * mysettings.nr_runs * sizeof(uint64_t));
+    msg_verify.failures = 0;
+    if(mysettings.one_way || (mysettings.trace_file && mysettings.trace_align))
+      clock_sync(MPI_COMM_WORLD);
     for(unsigned int j = 0; j < mysettings.nr_runs; j++) {
       /* now start with the ring test */
-      struct timespec time_rcv, time_snd, time_probe;
-      time_snd.tv_sec = 0; time_snd.tv_nsec = 0;
-      time_rcv.tv_sec = 0; time_rcv.tv_nsec = 0;
-      time_probe.tv_sec = 0; time_probe.tv_nsec = 0;
+      uint64_t time_snd = 0, time_rcv = 0, time_probe = 0;
+      memset(&leg_stamps, 0, sizeof(leg_stamps));
       switch(mysettings.mode) {
         case round_trip:
-          round_trip_func(pkg_size, &time_snd, &time_rcv, msg_count);
+          round_trip_func(&buf, &time_snd, &time_rcv, msg_count);
           msg_count++;
           break;
         case round_trip_total:
-          round_trip_total_func(pkg_size, &time_snd, msg_count);
+          round_trip_total_func(&buf, &time_snd, msg_count);
           msg_count++;
           break;
         case dround_trip:
-          dround_trip_func(pkg_size, &time_snd, &time_rcv, msg_count);
+          dround_trip_func(&buf, &time_snd, &time_rcv, msg_count);
           msg_count++;
           break;
         case round_trip_msg_size:
-          round_trip_msg_size_func(pkg_size, &time_snd, &time_rcv, &time_probe,msg_count);
+          round_trip_msg_size_func(&buf, &time_snd, &time_rcv, &time_probe,msg_count);
           msg_count++;
           break;
         case round_trip_sync:
-          round_trip_sync_func(pkg_size, &time_snd, &time_rcv,msg_count);
+          round_trip_sync_func(&buf, &time_snd, &time_rcv,msg_count);
           msg_count++;
           break;
         case round_trip_wait:
-          round_trip_wait_func(pkg_size, &time_snd, &time_rcv, msg_count, mysettings.wait);
+          round_trip_wait_func(&buf, &time_snd, &time_rcv, msg_count, mysettings.wait);
           msg_count++;
           break;
         case send:
-          send_func(pkg_size, &time_snd, &time_rcv, msg_count);
+          send_func(&buf, &time_snd, &time_rcv, msg_count);
           msg_count++;
           break;
         case send_delay:
-          send_delay_func(pkg_size, &time_snd, &time_rcv, msg_count, mysettings.wait);
+          send_delay_func(&buf, &time_snd, &time_rcv, msg_count, mysettings.wait);
           msg_count++;
           break;
         case round_trip_delay:
-          round_trip_delayed_func(pkg_size, &time_snd, &time_rcv, msg_count, mysettings.wait);
+          round_trip_delayed_func(&buf, &time_snd, &time_rcv, msg_count, mysettings.wait);
           msg_count++;
           break;
         case single_trip:
-          single_trip_func(pkg_size, &time_snd, &time_rcv, msg_count);
+          single_trip_func(&buf, &time_snd, &time_rcv, msg_count);
           msg_count++;
           break;
         case round_trip_wait_recv:
-          round_trip_wait_recv_func(pkg_size,&time_snd,&time_rcv,msg_count,mysettings.wait);
+          round_trip_wait_recv_func(&buf,&time_snd,&time_rcv,msg_count,mysettings.wait);
+          msg_count++;
+          break;
+        case round_trip_persist:
+          round_trip_persist_func(&buf, &time_snd, &time_rcv, msg_count);
+          msg_count++;
+          break;
+        case send_persist:
+          send_persist_func(&buf, &time_snd, &time_rcv, msg_count);
+          msg_count++;
+          break;
+        case send_bw:
+          send_bw_func(&buf, &time_snd, &time_rcv, msg_count, mysettings.window);
+          msg_count++;
+          break;
+        case send_bibw:
+          send_bibw_func(&buf, &time_snd, &time_rcv, msg_count, mysettings.window);
+          msg_count++;
+          break;
+        case msg_rate:
+          msg_rate_func(&buf, &time_snd, &time_rcv, msg_count, mysettings.window,
+              pair_index < pairs);
+          msg_count++;
+          break;
+        case allreduce:
+          collective_func(&buf, &time_snd, msg_count, coll_allreduce);
+          msg_count++;
+          break;
+        case bcast:
+          collective_func(&buf, &time_snd, msg_count, coll_bcast);
+          msg_count++;
+          break;
+        case reduce:
+          collective_func(&buf, &time_snd, msg_count, coll_reduce);
+          msg_count++;
+          break;
+        case allgather:
+          collective_func(&buf, &time_snd, msg_count, coll_allgather);
+          msg_count++;
+          break;
+        case alltoall:
+          collective_func(&buf, &time_snd, msg_count, coll_alltoall);
+          msg_count++;
+          break;
+        case reduce_scatter:
+          collective_func(&buf, &time_snd, msg_count, coll_reduce_scatter);
+          msg_count++;
+          break;
+        case dt_contig_mode:
+        case dt_vector_mode:
+        case dt_indexed_mode:
+        case dt_subarray_mode:
+        case dt_manual_mode:
+          datatype_func(&dt, &time_snd, &time_rcv, &time_probe, msg_count);
+          msg_count++;
+          break;
+        case rma_put:
+          rma_func(&win, &buf, &time_snd, &time_probe, msg_count, rma_op_put,
+              mysettings.rma_ops);
+          msg_count++;
+          break;
+        case rma_get:
+          rma_func(&win, &buf, &time_snd, &time_probe, msg_count, rma_op_get,
+              mysettings.rma_ops);
+          msg_count++;
+          break;
+        case rma_acc:
+          rma_func(&win, &buf, &time_snd, &time_probe, msg_count, rma_op_acc,
+              mysettings.rma_ops);
           msg_count++;
           break;
         default:
@@ -306,146 +1547,291 @@ main(int argc, char** argv) {
           exit(EXIT_FAILURE);
       }
 
-      times_snd[j] = tlog_timespec_to_fp(&time_snd);
-      times_rcv[j] = tlog_timespec_to_fp(&time_rcv);
-      times_prb[j] = tlog_timespec_to_fp(&time_probe);
-    }
-
-    if (mysettings.time_evolution == 0) {
-      gsl_sort(times_snd, 1, mysettings.nr_runs);
-      gsl_sort(times_rcv, 1, mysettings.nr_runs);
-      gsl_sort(times_prb, 1, mysettings.nr_runs);
-
-      double send_bf[15] = {
-          gsl_stats_max(times_snd, 1, mysettings.nr_runs),
-	  gsl_stats_min(times_snd, 1, mysettings.nr_runs),
-          gsl_stats_mean(times_snd, 1, mysettings.nr_runs),
-	  gsl_stats_median_from_sorted_data(times_snd, 1, mysettings.nr_runs),
-          gsl_stats_variance(times_snd, 1, mysettings.nr_runs),
-          gsl_stats_max(times_rcv,1, mysettings.nr_runs),
-	  gsl_stats_min(times_rcv, 1, mysettings.nr_runs),
-          gsl_stats_mean(times_rcv, 1, mysettings.nr_runs),
-	  gsl_stats_median_from_sorted_data(times_rcv, 1, mysettings.nr_runs),
-          gsl_stats_variance(times_rcv, 1, mysettings.nr_runs),
-          gsl_stats_max(times_prb, 1, mysettings.nr_runs),
-	  gsl_stats_min(times_prb,1,mysettings.nr_runs),
-          gsl_stats_mean(times_prb, 1, mysettings.nr_runs),
-	  gsl_stats_median_from_sorted_data(times_prb, 1, mysettings.nr_runs),
-          gsl_stats_variance(times_prb, 1, mysettings.nr_runs)
-      };
+      if(trace.events) {
+        for(unsigned int k = 0; k < 3; k++)
+          if(leg_stamps.legs & (1u << k))
+            trace_add(&trace, leg_stamps.begin[k], leg_stamps.end[k], pkg_size, j,
+                peer[k], k);
+      }
+      if(mysettings.one_way) {
+        /* the receive leg follows once the send starts are known */
+        const unsigned int h = j % hop_chunk;
+        hop_snd[h] = leg_stamps.legs & (1u << leg_snd) ?
+          clock_global(timer_ns(leg_stamps.begin[leg_snd])) : 0;
+        hop_rcv[h] = leg_stamps.legs & (1u << leg_rcv) ?
+          clock_global(timer_ns(leg_stamps.end[leg_rcv])) : 0;
+        /*
+         * every rank runs the same runs, so all of them exchange a full
+         * chunk at the same run; all messages of this run are matched by now
+         */
+        if(h + 1 == hop_chunk || j + 1 == mysettings.nr_runs) {
+          const unsigned int first = j - h;
+          MPI_Sendrecv(hop_snd, h + 1, MPI_UINT64_T, hop_next, MAGIC_ID,
+		       hop_prev, h + 1, MPI_UINT64_T, hop_prev_rank, MAGIC_ID,
+		       MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+          for(unsigned int i = 0; i <= h && hop_prev_rank != MPI_PROC_NULL; i++) {
+            if(hop_rcv[i] == 0 || hop_prev[i] == 0)
+              continue;
+            /* a receive ending before the send started is an error of the sync */
+            uint64_t one_way = hop_rcv[i] > hop_prev[i] ? hop_rcv[i] - hop_prev[i] : 0;
+            stats_add(&run_stats[1], one_way);
+            if(!online)
+              times_rcv[mysettings.time_evolution ? first + i : nr_samples[leg_rcv]] =
+                one_way;
+            nr_samples[leg_rcv]++;
+          }
+        }
+      }
+      const uint64_t sample[3] = { time_snd, time_rcv, time_probe };
+      for(unsigned int k = 0; k < 3; k++) {
+        /* only the legs this rank took part in, the --one-way rcv is added above */
+        if(!(leg_stamps.legs & (1u << k)) || (mysettings.one_way && k == leg_rcv))
+          continue;
+        stats_add(&run_stats[k], sample[k]);
+        /* -e keeps every run in its place, the statistics only need the samples */
+        if(!online)
+          times[k * mysettings.nr_runs + (mysettings.time_evolution ? j : nr_samples[k])] =
+            sample[k];
+        nr_samples[k]++;
+      }
+    }
+    if(is_rma(mysettings.mode))
+      rma_win_free(&win);
+    if(dt_mode_layout(mysettings.mode) >= 0)
+      dt_msg_free(&dt);
+    msg_buf_free(&buf);
+
+    /* failed checks of all ranks for this message size */
+    uint64_t verify_fail = 0;
+    if(mysettings.verify) {
+      MPI_Reduce(&msg_verify.failures, &verify_fail, 1, MPI_UINT64_T, MPI_SUM, 0,
+          MPI_COMM_WORLD);
+      if(world_rank == 0 && mysettings.time_evolution)
+        output_comment(&out, "Verification failures for size %zu: %lu",
+            pkg_size, (unsigned long) verify_fail);
+    }
+
+    if (mysettings.time_evolution == 0 && !mysettings.by_rank) {
+      struct stats *global_stats = NULL;
+      /* per leg mean and rank of the slowest rank for the i_avg columns */
+      struct { double mean; int rank; } slowest[3], slowest_gl[3];
+      /* receive time sum and count of the even and odd ranks, message rate
+         and number of senders, probe time sum and count of the even and odd ranks */
+      double extra[10] = { 0 }, extra_gl[10];
+
+      for(unsigned int k = 0; k < 3; k++) {
+        slowest[k].mean = stats_mean(&run_stats[k]);
+        slowest[k].rank = world_rank;
+      }
+      extra[2 * (world_rank % 2)] = stats_mean(&run_stats[1]) * run_stats[1].n;
+      extra[2 * (world_rank % 2) + 1] = run_stats[1].n;
+      extra[6 + 2 * (world_rank % 2)] = stats_mean(&run_stats[2]) * run_stats[2].n;
+      extra[6 + 2 * (world_rank % 2) + 1] = run_stats[2].n;
+      if(world_rank % 2 == 0 && run_stats[0].n > 0) {
+        extra[4] = mysettings.window * (double) NSEC_PER_SEC / stats_mean(&run_stats[0]);
+        extra[5] = 1;
+      }
+      if(mysettings.node_split) {
+        for(unsigned int k = 0; k < 3; k++) {
+          stats_init(&split_stats[2 * k + hop_intra]);
+          stats_init(&split_stats[2 * k + hop_inter]);
+          if(leg_class[k] != hop_none)
+            split_stats[2 * k + leg_class[k]] = run_stats[k];
+        }
+      }
+      if(world_rank == 0)
+        global_stats = malloc((mysettings.node_split ? 9 : 3) * sizeof(struct stats));
+
+      clock_gettime(CLOCK_MONOTONIC, &time_start);
+      stats_reduce(run_stats, global_stats, 3, 0, MPI_COMM_WORLD);
+      if(mysettings.node_split)
+        stats_reduce(split_stats, world_rank == 0 ? global_stats + 3 : NULL, 6, 0,
+            MPI_COMM_WORLD);
+      MPI_Reduce(slowest, slowest_gl, 3, MPI_DOUBLE_INT, MPI_MAXLOC, 0, MPI_COMM_WORLD);
+      MPI_Reduce(extra, extra_gl, 10, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+      clock_gettime(CLOCK_MONOTONIC, &time_end);
+      tlog_timespec_sub(&time_end, &time_start, &time_diff);
+
+      if (world_rank == 0) {
+        output_comment(&out, "Time for reduce %lu.%lu", time_diff.tv_sec, time_diff.tv_nsec);
+        output_text_header(&out);
+        output_record_begin(&out, mysettings.mode_name, pkg_size, -1);
+        for(unsigned int k = 0; k < 3; k++) {
+          output_time(&out, col_names[5 * k + 0], global_stats[k].max);
+          output_time(&out, col_names[5 * k + 1], global_stats[k].min);
+          output_time(&out, col_names[5 * k + 2], stats_mean(&global_stats[k]));
+          output_time(&out, col_names[5 * k + 3], stats_percentile(&global_stats[k], 50));
+          output_double(&out, col_names[5 * k + 4], variance_sec(stats_variance(&global_stats[k])));
+        }
+        output_int(&out, "i_avg_snd", slowest_gl[0].rank);
+        output_int(&out, "i_avg_rcv", slowest_gl[1].rank);
+        output_int(&out, "i_avg_prb", slowest_gl[2].rank);
+        for(unsigned int k = 0; k < 3; k++) {
+          for(unsigned int l = 0; l < mysettings.nr_percentiles; l++)
+            output_time(&out, col_names[15 + k * mysettings.nr_percentiles + l],
+                stats_percentile(&global_stats[k], mysettings.percentiles[l]));
+        }
+        output_double(&out, "bw_snd", bandwidth(iter_size, stats_mean(&global_stats[0])));
+        output_double(&out, "bw_rcv", bandwidth(iter_size, stats_mean(&global_stats[1])));
+        if(mysettings.mode == send_bibw) {
+          /* what the odd ranks receive went from even to odd and vice versa */
+          double bw_even_odd = bandwidth(iter_size, extra_gl[3] > 0 ? extra_gl[2] / extra_gl[3] : 0);
+          double bw_odd_even = bandwidth(iter_size, extra_gl[1] > 0 ? extra_gl[0] / extra_gl[1] : 0);
+          output_double(&out, "bw_even_odd", bw_even_odd);
+          output_double(&out, "bw_odd_even", bw_odd_even);
+          output_double(&out, "bw_agg", bw_even_odd + bw_odd_even);
+        }
+        if(mysettings.mode == msg_rate) {
+          /* every active sender contributes window messages per avg_snd_t */
+          output_uint(&out, "pairs", pairs);
+          output_double(&out, "msg_rate", extra_gl[4]);
+          output_double(&out, "msg_rate_pair", extra_gl[5] > 0 ? extra_gl[4] / extra_gl[5] : 0);
+        }
+        if(mysettings.mode == dt_manual_mode) {
+          /* the even ranks pack, the odd ones unpack */
+          output_time(&out, "avg_pack_t", extra_gl[7] > 0 ? extra_gl[6] / extra_gl[7] : 0);
+          output_time(&out, "avg_unpack_t", extra_gl[9] > 0 ? extra_gl[8] / extra_gl[9] : 0);
+        }
+        for(unsigned int k = 0; mysettings.node_split && k < 3; k++) {
+          for(unsigned int c = 0; c < 2; c++) {
+            const struct stats *split = &global_stats[3 + 2 * k + c];
+            char name[COLUMN_NAME_LEN];
+            snprintf(name, sizeof(name), "avg_%s_%s_t", leg_names[k], hop_names[c]);
+            output_time(&out, name, stats_mean(split));
+            snprintf(name, sizeof(name), "med_%s_%s_t", leg_names[k], hop_names[c]);
+            output_time(&out, name, stats_percentile(split, 50));
+          }
+        }
+        if(mysettings.verify)
+          output_uint(&out, "verify_fail", verify_fail);
+        output_record_end(&out);
+	free(global_stats);
+      }
+    } else if (mysettings.time_evolution == 0) {
+      /*
+       * max min avg med var of every leg, then the percentiles of every leg,
+       * in ns (ns^2), doubles hold the integer ones exactly
+       */
+      const unsigned int nr_pct = mysettings.nr_percentiles;
+      const unsigned int nr_stats = 15 + 3 * nr_pct;
+      const unsigned int nr_hops = mysettings.node_split ? 3 : 0;
+      const unsigned int nr_vals = nr_stats + nr_hops + (mysettings.verify ? 1 : 0);
+      double send_bf[MAX_RANK_VALS];
+
+      if(online) {
+        for(unsigned int k = 0; k < 3; k++) {
+          send_bf[5 * k + 0] = run_stats[k].max;
+          send_bf[5 * k + 1] = run_stats[k].min;
+          send_bf[5 * k + 2] = stats_mean(&run_stats[k]);
+          send_bf[5 * k + 3] = stats_percentile(&run_stats[k], 50);
+          send_bf[5 * k + 4] = stats_variance(&run_stats[k]);
+          for(unsigned int l = 0; l < nr_pct; l++)
+            send_bf[15 + k * nr_pct + l] = stats_percentile(&run_stats[k], mysettings.percentiles[l]);
+        }
+      } else {
+        uint64_t *legs[3] = { times_snd, times_rcv, times_prb };
+        for(unsigned int k = 0; k < 3; k++) {
+          struct stats_summary summary;
+          stats_summary(legs[k], nr_samples[k], &summary);
+          send_bf[5 * k + 0] = summary.max;
+          send_bf[5 * k + 1] = summary.min;
+          send_bf[5 * k + 2] = summary.mean;
+          send_bf[5 * k + 3] = stats_median(legs[k], nr_samples[k]);
+          send_bf[5 * k + 4] = summary.variance;
+          for(unsigned int l = 0; l < nr_pct; l++)
+            send_bf[15 + k * nr_pct + l] = stats_array_percentile(legs[k], nr_samples[k],
+                mysettings.percentiles[l]);
+        }
+      }
+
+      for(unsigned int k = 0; k < nr_hops; k++)
+        send_bf[nr_stats + k] = leg_class[k];
+      if(mysettings.verify)
+        send_bf[nr_stats + nr_hops] = msg_verify.failures;
 
       if (world_rank == 0 ) {
-        double *recv_bf = calloc(world_size * 15,sizeof(double));
+        double *recv_bf = calloc(world_size * nr_vals,sizeof(double));
 
         clock_gettime(CLOCK_MONOTONIC, &time_start);
-        MPI_Gather(send_bf, 15, MPI_DOUBLE,
-		   recv_bf, 15, MPI_DOUBLE,
+        MPI_Gather(send_bf, nr_vals, MPI_DOUBLE,
+		   recv_bf, nr_vals, MPI_DOUBLE,
 		   0, MPI_COMM_WORLD);
         clock_gettime(CLOCK_MONOTONIC, &time_end);
         tlog_timespec_sub(&time_end, &time_start, &time_diff);
 
-        printf("# Time for gather %lu.%lu\n",time_diff.tv_sec,time_diff.tv_nsec);
-        printf("# max_snd_t min_snd_t avg_snd_t med_snd_t var_snd_t "
-	       "max_rcv_t min_rcv_t avg_rcv_t med_rcv_t var_rcv_t "
-	       "max_prb_t min_prb_t avg_prb_t med_prb_t var_prb_t i_avg_snd i_avg_rcv i_min_prb\n");
-	if (!mysettings.by_rank) {
-	  printf("%i",pkg_size);
-	  printf(" %g %g %g %g %g",
-		 gsl_stats_max(&recv_bf[0], 15, world_size),
-		 gsl_stats_min(&recv_bf[1], 15, world_size),
-		 gsl_stats_mean(&recv_bf[2], 15, world_size),
-		 gsl_stats_mean(&recv_bf[3], 15, world_size),
-		 gsl_stats_mean(&recv_bf[4], 15, world_size));
-	  printf(" %g %g %g %g %g",
-		 gsl_stats_max(&recv_bf[5], 15, world_size),
-		 gsl_stats_min(&recv_bf[6], 15, world_size),
-		 gsl_stats_mean(&recv_bf[7], 15, world_size),
-		 gsl_stats_mean(&recv_bf[8], 15, world_size),
-		 gsl_stats_mean(&recv_bf[9], 15, world_size));
-	  printf(" %g %g %g %g %g",
-		 gsl_stats_max(&recv_bf[10], 15, world_size),
-		 gsl_stats_min(&recv_bf[11], 15, world_size),
-		 gsl_stats_mean(&recv_bf[12], 15, world_size),
-		 gsl_stats_mean(&recv_bf[13], 15, world_size),
-		 gsl_stats_mean(&recv_bf[14], 15, world_size));
-	  printf(" %lu %lu %lu",
-		 (gsl_stats_max_index(&recv_bf[2], 15, world_size)),
-		 (gsl_stats_max_index(&recv_bf[7], 15, world_size)),
-		 (gsl_stats_max_index(&recv_bf[12], 15, world_size)));
-	  printf("\n");
-	} else {
-	  for (int i=0; i < world_size; i++) {
-	    printf("[%i] %i",i,pkg_size);
-	    printf(" %g %g %g %g %g",
-		   recv_bf[0 + 15 * i],
-		   recv_bf[1 + 15 * i],
-		   recv_bf[2 + 15 * i],
-	           recv_bf[3 + 15 * i],
-		   recv_bf[4 + 15 * i]);
-	    printf(" %g %g %g %g %g",
-		   recv_bf[5 + 15 * i],
-		   recv_bf[6 + 15 * i],
-		   recv_bf[7 + 15 * i],
-		   recv_bf[8 + 15 * i],
-		   recv_bf[9 + 15 * i]);
-	    printf(" %g %g %g %g %g",
-		   recv_bf[10 + 15 * i],
-		   recv_bf[11 + 15 * i],
-		   recv_bf[12 + 15 * i],
-		   recv_bf[13 + 15 * i],
-		   recv_bf[14 + 15 * i]);
-	    printf("\n");
-	  }
-	}
+        output_comment(&out, "Time for gather %lu.%lu", time_diff.tv_sec, time_diff.tv_nsec);
+        output_text_header(&out);
+        for (int i=0; i < world_size; i++) {
+          double *rank_bf = &recv_bf[nr_vals * i];
+          output_record_begin(&out, mysettings.mode_name, pkg_size, i);
+          for(unsigned int k = 0; k < nr_stats; k++) {
+            /* everything but the variances is a time */
+            if(k < 15 && k % 5 == 4)
+              output_double(&out, col_names[k], variance_sec(rank_bf[k]));
+            else
+              output_time(&out, col_names[k], rank_bf[k]);
+          }
+          output_double(&out, "bw_snd", bandwidth(iter_size, rank_bf[2]));
+          output_double(&out, "bw_rcv", bandwidth(iter_size, rank_bf[7]));
+          /* 0 intra-node, 1 inter-node, -1 no peer */
+          for(unsigned int k = 0; k < nr_hops; k++) {
+            char name[COLUMN_NAME_LEN];
+            snprintf(name, sizeof(name), "%s_hop", leg_names[k]);
+            output_int(&out, name, rank_bf[nr_stats + k]);
+          }
+          if(mysettings.verify)
+            output_uint(&out, "verify_fail", rank_bf[nr_stats + nr_hops]);
+          output_record_end(&out);
+        }
         free(recv_bf);
       } else {
-        MPI_Gather(send_bf, 15, MPI_DOUBLE,
-		   NULL, 15, MPI_DOUBLE,
+        MPI_Gather(send_bf, nr_vals, MPI_DOUBLE,
+		   NULL, nr_vals, MPI_DOUBLE,
 		   0,MPI_COMM_WORLD);
       }
 
-    } else { // mysettings.time_evolution == 0
-      double *send_bf = calloc(mysettings.nr_runs*3,sizeof(double));
-
-      memcpy(send_bf, times_snd, mysettings.nr_runs*sizeof(double));
-      memcpy(send_bf+mysettings.nr_runs, times_rcv, mysettings.nr_runs*sizeof(double));
-      memcpy(send_bf+2*mysettings.nr_runs, times_prb, mysettings.nr_runs*sizeof(double));
-
-      if(world_rank != 0) {
-        MPI_Gather(send_bf, mysettings.nr_runs*3, MPI_DOUBLE,
-		   NULL, mysettings.nr_runs*3, MPI_DOUBLE,
-		   0,MPI_COMM_WORLD);
-      } else {
-        double *rcv_buffer = calloc(mysettings.nr_runs*3*world_size, sizeof(double));
-        MPI_Gather(send_bf, mysettings.nr_runs*3, MPI_DOUBLE,
-		   rcv_buffer, mysettings.nr_runs*3, MPI_DOUBLE,
-		   0, MPI_COMM_WORLD);
-        for(unsigned int k = 0; k < mysettings.nr_runs; k++) {
-          printf("%i",pkg_size);
-          for(int l = 0; l < world_size; l++) {
-            printf(" %g %g %g", rcv_buffer[k+(3*mysettings.nr_runs*l)],
-                rcv_buffer[k+mysettings.nr_runs+(3*mysettings.nr_runs*l)],
-                rcv_buffer[k+2*mysettings.nr_runs+(3*mysettings.nr_runs*l)]);
-          }
-          printf("\n");
-        }
-        free(rcv_buffer);
+    } else if (evolution_file) {
+      if(sample_file_write(evolution_file, step, times) != MPI_SUCCESS) {
+        fprintf(stderr, "Could not write %s on rank %i\n", mysettings.evolution_file, world_rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
       }
-      free(send_bf);
+    } else { // mysettings.time_evolution == 0
+      print_time_evolution(&out, &mysettings, pkg_size, times);
     }
+    output_flush(&out);
+  }
+
+  sample_file_close(evolution_file);
+  if(trace.events) {
+    if(trace_write(&trace, mysettings.trace_file, mysettings.mode_name,
+		   mysettings.one_way || mysettings.trace_align) != MPI_SUCCESS)
+      fprintf(stderr, "Could not write %s on rank %i\n", mysettings.trace_file, world_rank);
+    trace_free(&trace);
+  }
+  free(run_stats);
+  free(times);
+  free(hop_snd);
+  free(matrix_row);
+  free(split_stats);
+  if(thread_stats) {
+    thread_rate_free();
+    free(thread_stats);
   }
+  free(node_of);
+  free(mysettings.sizes);
 
   clock_gettime(CLOCK_MONOTONIC, &time_start);
   MPI_Finalize();
   clock_gettime(CLOCK_MONOTONIC, &time_end);
   tlog_timespec_sub(&time_end, &time_start, &time_diff);
-  printf("# MPI_Finalize[%i]: %li.%li\n",
-	 world_rank, time_diff.tv_sec, time_diff.tv_nsec);
+  output_comment(&out, "MPI_Finalize[%i]: %li.%li",
+		 world_rank, time_diff.tv_sec, time_diff.tv_nsec);
 
   clock_gettime(CLOCK_MONOTONIC, &time_gl_end);
   tlog_timespec_sub(&time_gl_end, &time_gl_start, &time_gl_diff);
-  printf("# Total run time [%i]: %li.%li\n",
-	 world_rank, time_gl_diff.tv_sec, time_gl_diff.tv_nsec);
+  output_comment(&out, "Total run time [%i]: %li.%li",
+		 world_rank, time_gl_diff.tv_sec, time_gl_diff.tv_nsec);
+  output_close(&out);
 
   exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2021 SUSE
+ *
+ * This file is part of mpi_timing.
+ *
+ * mpi_timing is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpi_timing is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* print the binary time evolution of mpi_timing -E in the text layout of -e */
+
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "sample_file.h"
+#include "output.h"
+
+/* bound of the samples of all ranks held at once */
+#define CONV_MEMORY (64 << 20)
+
+int
+main(int argc, char** argv)
+{
+  struct sample_file_header header;
+  uint64_t *sizes;
+  char (*hosts)[SAMPLE_FILE_HOST_LEN];
+  uint64_t *step;
+  size_t chunk;
+  FILE *in;
+
+  if(argc != 2) {
+    fprintf(stderr, "\tUsage: mpi_timing_conv FILE\n");
+    fprintf(stderr, "\tprint the time evolution written by mpi_timing -E FILE as text\n");
+    exit(EXIT_FAILURE);
+  }
+  in = fopen(argv[1], "rb");
+  if(in == NULL) {
+    perror(argv[1]);
+    exit(EXIT_FAILURE);
+  }
+  if(fread(&header, sizeof(header), 1, in) != 1 ||
+     memcmp(header.magic, SAMPLE_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+     header.version != SAMPLE_FILE_VERSION ||
+     header.nr_legs != SAMPLE_FILE_LEGS) {
+    fprintf(stderr, "%s is not a mpi_timing sample file of version %i\n",
+	    argv[1], SAMPLE_FILE_VERSION);
+    exit(EXIT_FAILURE);
+  }
+  header.mode[SAMPLE_FILE_MODE_LEN - 1] = '\0';
+  /* the offsets of all blocks have to fit into off_t */
+  if(header.nr_ranks == 0 ||
+     header.nr_runs > INT64_MAX / 2 / (header.nr_legs * sizeof(uint64_t)) ||
+     sample_file_block_size(&header) > INT64_MAX / 2 / header.nr_ranks /
+     (header.nr_sizes ? header.nr_sizes : 1)) {
+    fprintf(stderr, "%s has an invalid header\n", argv[1]);
+    exit(EXIT_FAILURE);
+  }
+
+  /* chunk runs of every leg of all ranks at a time */
+  chunk = CONV_MEMORY / ((size_t) header.nr_ranks * header.nr_legs * sizeof(uint64_t));
+  if(chunk == 0)
+    chunk = 1;
+  if(chunk > header.nr_runs)
+    chunk = header.nr_runs ? header.nr_runs : 1;
+
+  sizes = malloc(header.nr_sizes * sizeof(uint64_t));
+  hosts = malloc((size_t) header.nr_ranks * SAMPLE_FILE_HOST_LEN);
+  step = malloc(chunk * header.nr_ranks * header.nr_legs * sizeof(uint64_t));
+  if(sizes == NULL || hosts == NULL || step == NULL) {
+    fprintf(stderr, "Could not allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  if(fread(sizes, sizeof(uint64_t), header.nr_sizes, in) != header.nr_sizes ||
+     fread(hosts, SAMPLE_FILE_HOST_LEN, header.nr_ranks, in) != header.nr_ranks) {
+    fprintf(stderr, "%s is truncated\n", argv[1]);
+    exit(EXIT_FAILURE);
+  }
+
+  printf("# Mode: %s\n", header.mode);
+  printf("# Nr of processors are: %u\n", header.nr_ranks);
+  for(unsigned int i = 0; i < header.nr_ranks; i++) {
+    hosts[i][SAMPLE_FILE_HOST_LEN - 1] = '\0';
+    printf("# [%u] %s\n", i, hosts[i]);
+  }
+
+  /*
+   * the samples of a step are stored rank by rank, but printed run by
+   * run, so read chunk runs of every leg of every rank at a time
+   */
+  for(unsigned int s = 0; s < header.nr_sizes; s++) {
+    for(uint64_t first = 0; first < header.nr_runs; first += chunk) {
+      size_t n = header.nr_runs - first < chunk ? header.nr_runs - first : chunk;
+      for(unsigned int r = 0; r < header.nr_ranks; r++) {
+        for(unsigned int l = 0; l < header.nr_legs; l++) {
+          uint64_t *leg = &step[((size_t) r * header.nr_legs + l) * chunk];
+          off_t offset = sample_file_block_offset(&header, s, r) +
+            (l * header.nr_runs + first) * sizeof(uint64_t);
+          if(fseeko(in, offset, SEEK_SET) != 0 || fread(leg, sizeof(uint64_t), n, in) != n) {
+            fprintf(stderr, "%s is truncated\n", argv[1]);
+            exit(EXIT_FAILURE);
+          }
+        }
+      }
+      for(size_t k = 0; k < n; k++) {
+        printf("%lu", (unsigned long) sizes[s]);
+        for(unsigned int r = 0; r < header.nr_ranks; r++) {
+          for(unsigned int l = 0; l < header.nr_legs; l++) {
+            char num[32];
+            output_format_ns(num, step[((size_t) r * header.nr_legs + l) * chunk + k]);
+            printf(" %s", num);
+          }
+        }
+        printf("\n");
+      }
+    }
+  }
+
+  free(step);
+  free(hosts);
+  free(sizes);
+  fclose(in);
+  exit(EXIT_SUCCESS);
+}
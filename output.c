@@ -0,0 +1,399 @@
+#include "output.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* exact powers of ten */
+static const double pow10_tab[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/* v * 10^k, dividing by exact powers where possible */
+static double
+scale10(double v, int k)
+{
+  if(k >= 0)
+    return k <= 22 ? v * pow10_tab[k] : v * pow(10, k);
+  return -k <= 22 ? v / pow10_tab[-k] : v / pow(10, -k);
+}
+
+int
+output_format_uint(char *p, uint64_t v)
+{
+  char tmp[20];
+  int n = 0;
+
+  do {
+    tmp[n++] = '0' + v % 10;
+    v /= 10;
+  } while(v);
+  for(int i = 0; i < n; i++)
+    p[i] = tmp[n - 1 - i];
+  p[n] = '\0';
+  return n;
+}
+
+int
+output_format_ns(char *p, uint64_t ns)
+{
+  int n = output_format_uint(p, ns / 1000000000);
+  uint32_t frac = ns % 1000000000;
+  int digits = 9;
+
+  if(frac == 0)
+    return n;
+  while(frac % 10 == 0) {
+    frac /= 10;
+    digits--;
+  }
+  p[n++] = '.';
+  for(int i = digits - 1; i >= 0; i--) {
+    p[n + i] = '0' + frac % 10;
+    frac /= 10;
+  }
+  n += digits;
+  p[n] = '\0';
+  return n;
+}
+
+int
+output_format_double(char *p, double v)
+{
+  char *start = p;
+  char d[6];
+  int e, nd = 6;
+  uint64_t m;
+  double a = fabs(v), scaled;
+
+  if(!isfinite(v) || v == 0 || a < 1e-290 || a > 1e290)
+    return snprintf(p, 32, "%g", v);
+
+  /* six significant digits m = d.ddddd * 10^5 */
+  e = (int) floor(log10(a));
+  scaled = scale10(a, 5 - e);
+  if(scaled >= 999999.5) {
+    e++;
+    scaled = scale10(a, 5 - e);
+  } else if(scaled < 99999.5) {
+    e--;
+    scaled = scale10(a, 5 - e);
+  }
+  /*
+   * scaled isn't exact, printf() rounds the exact decimal value, so leave
+   * the rare cases close to a tie to it
+   */
+  if(fabs(scaled - floor(scaled) - 0.5) < 1e-6)
+    return snprintf(p, 32, "%g", v);
+  m = llround(scaled);
+  if(v < 0)
+    *p++ = '-';
+  /* 9.999996 rounds up to 10.0000 */
+  if(m >= 1000000) {
+    e++;
+    m /= 10;
+  }
+  for(int i = 5; i >= 0; i--) {
+    d[i] = '0' + m % 10;
+    m /= 10;
+  }
+  while(nd > 1 && d[nd - 1] == '0')
+    nd--;
+
+  if(e < -4 || e >= 6) {
+    *p++ = d[0];
+    if(nd > 1) {
+      *p++ = '.';
+      memcpy(p, &d[1], nd - 1);
+      p += nd - 1;
+    }
+    *p++ = 'e';
+    *p++ = e < 0 ? '-' : '+';
+    if(e < 0)
+      e = -e;
+    if(e >= 100)
+      *p++ = '0' + e / 100;
+    *p++ = '0' + e / 10 % 10;
+    *p++ = '0' + e % 10;
+  } else if(e >= 0) {
+    memcpy(p, d, e + 1);
+    p += e + 1;
+    if(nd > e + 1) {
+      *p++ = '.';
+      memcpy(p, &d[e + 1], nd - e - 1);
+      p += nd - e - 1;
+    }
+  } else {
+    *p++ = '0';
+    *p++ = '.';
+    for(int i = 0; i < -e - 1; i++)
+      *p++ = '0';
+    memcpy(p, d, nd);
+    p += nd;
+  }
+  *p = '\0';
+  return p - start;
+}
+
+static int
+str_reserve(struct output_str *str, size_t n)
+{
+  if(str->len + n <= str->size)
+    return 0;
+  size_t size = str->size ? str->size : 256;
+  while(size < str->len + n)
+    size *= 2;
+  char *s = realloc(str->s, size);
+  if(s == NULL)
+    return -1;
+  str->s = s;
+  str->size = size;
+  return 0;
+}
+
+static void
+str_add(struct output_str *str, const char *s, size_t n)
+{
+  if(n == 0 || str_reserve(str, n) != 0)
+    return;
+  memcpy(str->s + str->len, s, n);
+  str->len += n;
+}
+
+static inline void
+str_addc(struct output_str *str, char c)
+{
+  if(str->len < str->size || str_reserve(str, 1) == 0)
+    str->s[str->len++] = c;
+}
+
+static void
+str_adds(struct output_str *str, const char *s)
+{
+  str_add(str, s, strlen(s));
+}
+
+/* JSON string, the names and modes never need more than quotes escaped */
+static void
+str_add_quoted(struct output_str *str, const char *s)
+{
+  str_addc(str, '"');
+  for(; *s; s++) {
+    if(*s == '"' || *s == '\\')
+      str_addc(str, '\\');
+    str_addc(str, *s);
+  }
+  str_addc(str, '"');
+}
+
+int
+output_parse_format(const char *name, enum output_format *format)
+{
+  if(strcmp(name, "text") == 0)
+    *format = output_text;
+  else if(strcmp(name, "csv") == 0)
+    *format = output_csv;
+  else if(strcmp(name, "json") == 0)
+    *format = output_json;
+  else
+    return -1;
+  return 0;
+}
+
+int
+output_init(struct output *out, enum output_format format)
+{
+  memset(out, 0, sizeof(*out));
+  out->format = format;
+  return str_reserve(&out->buf, OUTPUT_BUF_SIZE);
+}
+
+void
+output_flush(struct output *out)
+{
+  if(out->buf.len == 0)
+    return;
+  fwrite(out->buf.s, 1, out->buf.len, stdout);
+  fflush(stdout);
+  out->buf.len = 0;
+}
+
+void
+output_close(struct output *out)
+{
+  output_flush(out);
+  free(out->buf.s);
+  free(out->line.s);
+  free(out->names.s);
+  memset(out, 0, sizeof(*out));
+}
+
+void
+output_comment(struct output *out, const char *fmt, ...)
+{
+  va_list ap;
+  int n;
+
+  if(out->format != output_text)
+    return;
+  str_add(&out->buf, "# ", 2);
+  va_start(ap, fmt);
+  n = vsnprintf(NULL, 0, fmt, ap);
+  va_end(ap);
+  if(n < 0 || str_reserve(&out->buf, n + 1) != 0)
+    return;
+  va_start(ap, fmt);
+  vsnprintf(out->buf.s + out->buf.len, n + 1, fmt, ap);
+  va_end(ap);
+  out->buf.len += n;
+  str_addc(&out->buf, '\n');
+  if(out->buf.len >= OUTPUT_BUF_SIZE)
+    output_flush(out);
+}
+
+void
+output_text_header(struct output *out)
+{
+  if(out->format == output_text)
+    out->text_header = 1;
+}
+
+/* the names are only needed for a header which is still to be printed */
+static inline int
+want_names(const struct output *out)
+{
+  return (out->format == output_text && out->text_header) ||
+    (out->format == output_csv && !out->csv_header_done);
+}
+
+static void
+add_name(struct output *out, const char *name)
+{
+  if(out->nr_fields > 0)
+    str_addc(&out->names, out->format == output_csv ? ',' : ' ');
+  str_adds(&out->names, name);
+  out->nr_fields++;
+}
+
+/* separator and, for JSON, the name in front of a value */
+static void
+field_begin(struct output *out, const char *name)
+{
+  switch(out->format) {
+    case output_text:
+      str_addc(&out->line, ' ');
+      if(want_names(out))
+        add_name(out, name);
+      break;
+    case output_csv:
+      str_addc(&out->line, ',');
+      if(want_names(out))
+        add_name(out, name);
+      break;
+    case output_json:
+      str_addc(&out->line, ',');
+      str_add_quoted(&out->line, name);
+      str_addc(&out->line, ':');
+      break;
+  }
+}
+
+void
+output_record_begin(struct output *out, const char *mode, size_t size, int rank)
+{
+  char num[32];
+
+  out->line.len = 0;
+  out->names.len = 0;
+  out->nr_fields = 0;
+  switch(out->format) {
+    case output_text:
+      if(rank >= 0) {
+        str_addc(&out->line, '[');
+        str_add(&out->line, num, output_format_uint(num, rank));
+        str_add(&out->line, "] ", 2);
+      }
+      str_add(&out->line, num, output_format_uint(num, size));
+      return;
+    case output_csv:
+      if(want_names(out))
+        add_name(out, "mode");
+      str_adds(&out->line, mode);
+      break;
+    case output_json:
+      str_add(&out->line, "{\"mode\":", 8);
+      str_add_quoted(&out->line, mode);
+      break;
+  }
+  output_uint(out, "size", size);
+  if(rank >= 0)
+    output_int(out, "rank", rank);
+}
+
+void
+output_double(struct output *out, const char *name, double v)
+{
+  char num[32];
+
+  field_begin(out, name);
+  /* JSON has no inf or nan */
+  if(out->format == output_json && !isfinite(v))
+    str_add(&out->line, "null", 4);
+  else
+    str_add(&out->line, num, output_format_double(num, v));
+}
+
+void
+output_int(struct output *out, const char *name, int64_t v)
+{
+  char num[32];
+
+  field_begin(out, name);
+  if(v < 0) {
+    str_addc(&out->line, '-');
+    str_add(&out->line, num, output_format_uint(num, -(uint64_t) v));
+  } else {
+    str_add(&out->line, num, output_format_uint(num, v));
+  }
+}
+
+void
+output_uint(struct output *out, const char *name, uint64_t v)
+{
+  char num[32];
+
+  field_begin(out, name);
+  str_add(&out->line, num, output_format_uint(num, v));
+}
+
+void
+output_time(struct output *out, const char *name, double ns)
+{
+  char num[32];
+
+  field_begin(out, name);
+  str_add(&out->line, num, output_format_ns(num, ns > 0 ? llround(ns) : 0));
+}
+
+void
+output_record_end(struct output *out)
+{
+  if(out->format == output_text && out->text_header) {
+    str_add(&out->buf, "# ", 2);
+    str_add(&out->buf, out->names.s, out->names.len);
+    str_addc(&out->buf, '\n');
+    out->text_header = 0;
+  } else if(out->format == output_csv && !out->csv_header_done) {
+    str_add(&out->buf, out->names.s, out->names.len);
+    str_addc(&out->buf, '\n');
+    out->csv_header_done = 1;
+  }
+  if(out->format == output_json)
+    str_addc(&out->line, '}');
+  str_add(&out->buf, out->line.s, out->line.len);
+  str_addc(&out->buf, '\n');
+  if(out->buf.len >= OUTPUT_BUF_SIZE)
+    output_flush(out);
+}
@@ -0,0 +1,76 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Buffered result output. A result is a record of named fields, which is
+ * written as
+ *
+ *   text  the classic whitespace separated line, "[rank] size v1 v2 ...",
+ *         with optional "# name1 name2 ..." header lines and comments
+ *   csv   one header line with the field names, then one line per record
+ *   json  one JSON object per line (JSON Lines) with the field names
+ *
+ * Comments only show up in the text format. Everything is collected in a
+ * large buffer and written to stdout in big blocks, the numbers are
+ * formatted without going through printf().
+ */
+enum output_format {
+  output_text,
+  output_csv,
+  output_json,
+};
+
+#define OUTPUT_BUF_SIZE (1 << 20)
+
+struct output_str {
+  char *s;
+  size_t len;
+  size_t size;
+};
+
+struct output {
+  enum output_format format;
+  /* pending output for stdout */
+  struct output_str buf;
+  /* current record and the names of its fields */
+  struct output_str line;
+  struct output_str names;
+  unsigned int nr_fields;
+  unsigned int text_header;
+  unsigned int csv_header_done;
+};
+
+/* "text", "csv" or "json", returns -1 for anything else */
+int output_parse_format(const char *name, enum output_format *format);
+
+int output_init(struct output *out, enum output_format format);
+void output_flush(struct output *out);
+/* flushes and frees the buffers */
+void output_close(struct output *out);
+
+/* printf() like, "# " is prepended and only the text format prints it */
+void output_comment(struct output *out, const char *fmt, ...)
+  __attribute__((format(printf, 2, 3)));
+/* print a "# name1 name2 ..." line before the next record in the text format */
+void output_text_header(struct output *out);
+
+/* rank < 0 leaves out the rank, the text format doesn't show the mode */
+void output_record_begin(struct output *out, const char *mode, size_t size,
+    int rank);
+void output_double(struct output *out, const char *name, double v);
+void output_int(struct output *out, const char *name, int64_t v);
+void output_uint(struct output *out, const char *name, uint64_t v);
+/* nanoseconds, rounded to whole ones and printed as seconds without losing any */
+void output_time(struct output *out, const char *name, double ns);
+void output_record_end(struct output *out);
+
+/* like snprintf("%g") for buffers of at least 32 bytes, returns the length */
+int output_format_double(char *p, double v);
+int output_format_uint(char *p, uint64_t v);
+/* nanoseconds as seconds, e.g. 1234 -> 0.000001234 */
+int output_format_ns(char *p, uint64_t ns);
+
+#endif
@@ -0,0 +1,125 @@
+#include "pair_matrix.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "stats.h"
+
+int
+pair_nr_rounds(int size)
+{
+  return size % 2 == 0 ? size - 1 : size;
+}
+
+int
+pair_partner(int round, int rank, int size)
+{
+  /* the odd rank out plays against a dummy rank n - 1 */
+  int n = size % 2 == 0 ? size : size + 1, partner;
+
+  if(rank == n - 1)
+    partner = round;
+  else if(rank == round)
+    partner = n - 1;
+  else
+    partner = ((2 * round - rank) % (n - 1) + (n - 1)) % (n - 1);
+  return partner < size ? partner : -1;
+}
+
+/* nr_runs ping-pongs led by this rank, median half round trip in ns */
+static uint64_t
+ping_pong_lead(struct msg_buf *buf, void *data, int peer, unsigned int nr_runs,
+	       uint64_t *times)
+{
+  for(unsigned int i = 0; i < nr_runs; i++) {
+    uint64_t time_start = timer_read();
+    msg_send(data, buf->msg_size, peer, MAGIC_ID, MPI_COMM_WORLD);
+    msg_recv(data, buf->msg_size, peer, MAGIC_ID, MPI_COMM_WORLD);
+    times[i] = timer_elapsed(time_start, timer_read()) / 2;
+  }
+  return stats_median(times, nr_runs);
+}
+
+static void
+ping_pong_follow(struct msg_buf *buf, void *data, int peer, unsigned int nr_runs)
+{
+  for(unsigned int i = 0; i < nr_runs; i++) {
+    msg_recv(data, buf->msg_size, peer, MAGIC_ID, MPI_COMM_WORLD);
+    msg_send(data, buf->msg_size, peer, MAGIC_ID, MPI_COMM_WORLD);
+  }
+}
+
+/* nr_runs windows streamed to peer, median time of a window in ns */
+static uint64_t
+stream_lead(struct msg_buf *buf, void *data, int peer, unsigned int nr_runs,
+	    unsigned int window, uint64_t *times)
+{
+  unsigned int nr_reqs = msg_nr_requests(buf->msg_size);
+  MPI_Request *reqs = msg_buf_reqs(buf, window * nr_reqs);
+
+  for(unsigned int i = 0; i < nr_runs; i++) {
+    uint64_t time_start = timer_read();
+    for(unsigned int w = 0; w < window; w++)
+      msg_isend(data, buf->msg_size, peer, MAGIC_ID, MPI_COMM_WORLD, &reqs[w * nr_reqs]);
+    MPI_Waitall(window * nr_reqs, reqs, MPI_STATUSES_IGNORE);
+    MPI_Recv(NULL, 0, MPI_BYTE, peer, MAGIC_ID + 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    times[i] = timer_elapsed(time_start, timer_read());
+  }
+  return stats_median(times, nr_runs);
+}
+
+static void
+stream_follow(struct msg_buf *buf, void *data, int peer, unsigned int nr_runs,
+	      unsigned int window)
+{
+  unsigned int nr_reqs = msg_nr_requests(buf->msg_size);
+  MPI_Request *reqs = msg_buf_reqs(buf, window * nr_reqs);
+
+  for(unsigned int i = 0; i < nr_runs; i++) {
+    for(unsigned int w = 0; w < window; w++)
+      msg_irecv(data, buf->msg_size, peer, MAGIC_ID, MPI_COMM_WORLD, &reqs[w * nr_reqs]);
+    MPI_Waitall(window * nr_reqs, reqs, MPI_STATUSES_IGNORE);
+    MPI_Send(NULL, 0, MPI_BYTE, peer, MAGIC_ID + 1, MPI_COMM_WORLD);
+  }
+}
+
+void
+pair_matrix_row(struct msg_buf *buf, unsigned int nr_runs, unsigned int window,
+		uint64_t *lat, uint64_t *bw)
+{
+  uint64_t *times = malloc((nr_runs > 0 ? nr_runs : 1) * sizeof(uint64_t));
+  char *data = msg_buf_get(buf);
+
+  if(times == NULL) {
+    fprintf(stderr, "Could not allocate %u samples on rank %i\n", nr_runs, world_rank);
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
+  msg_header_write(data, buf->msg_size, 0);
+  for(int j = 0; j < world_size; j++) {
+    lat[j] = 0;
+    if(bw)
+      bw[j] = 0;
+  }
+
+  for(int round = 0; round < pair_nr_rounds(world_size); round++) {
+    int peer = pair_partner(round, world_rank, world_size);
+    /* keep the rounds apart, so only the pairs of one round compete */
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(peer < 0 || nr_runs == 0)
+      continue;
+    /* the lower rank leads first, then the roles are swapped */
+    for(int lead = 0; lead < 2; lead++) {
+      if((world_rank < peer) == (lead == 0)) {
+        lat[peer] = ping_pong_lead(buf, data, peer, nr_runs, times);
+        if(bw)
+          bw[peer] = stream_lead(buf, data, peer, nr_runs, window, times);
+      } else {
+        ping_pong_follow(buf, data, peer, nr_runs);
+        if(bw)
+          stream_follow(buf, data, peer, nr_runs, window);
+      }
+    }
+  }
+
+  msg_buf_put(buf, data);
+  free(times);
+}
@@ -0,0 +1,33 @@
+#ifndef PAIR_MATRIX_H
+#define PAIR_MATRIX_H
+
+#include <stdint.h>
+#include <mpi.h>
+
+#include "mpi_tests.h"
+
+/*
+ * Latency (and bandwidth) between every pair of ranks. The pairs are
+ * scheduled as a round robin tournament with the circle method: in each
+ * of the N - 1 rounds (N rounded up to even) every rank has exactly one
+ * partner, so N / 2 disjoint pairs are measured at the same time and the
+ * whole matrix takes N - 1 rounds instead of N^2 / 2 serial ping-pongs.
+ * Within a pair each rank leads once, so row i of the matrix is measured
+ * with the clock of rank i.
+ */
+
+/* partner of rank in round, -1 if it sits the round out */
+int pair_partner(int round, int rank, int size);
+/* number of rounds for size ranks */
+int pair_nr_rounds(int size);
+
+/*
+ * Fill the row of this rank: lat[j] is the median of nr_runs half round
+ * trips to rank j, bw[j] the median time of window streamed messages to
+ * rank j with a zero byte acknowledgement like send_bw, both in ns. bw
+ * may be NULL. The diagonal is 0. Collective over MPI_COMM_WORLD.
+ */
+void pair_matrix_row(struct msg_buf *buf, unsigned int nr_runs,
+    unsigned int window, uint64_t *lat, uint64_t *bw);
+
+#endif
@@ -0,0 +1,141 @@
+#include "rma.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int
+rma_parse_sync(const char *name, enum rma_sync *sync)
+{
+  if(strcmp(name, "fence") == 0)
+    *sync = rma_fence;
+  else if(strcmp(name, "lock") == 0)
+    *sync = rma_lock;
+  else if(strcmp(name, "pscw") == 0)
+    *sync = rma_pscw;
+  else
+    return -1;
+  return 0;
+}
+
+int
+rma_win_init(struct rma_win *w, size_t size, int target, int origin,
+	     enum rma_sync sync)
+{
+  MPI_Group world_group;
+  int ret;
+
+  w->sync = sync;
+  w->target = target;
+  ret = MPI_Win_allocate(size > 0 ? size : 1, 1, MPI_INFO_NULL, MPI_COMM_WORLD,
+      &w->base, &w->win);
+  if(ret != MPI_SUCCESS)
+    return ret;
+  MPI_Comm_group(MPI_COMM_WORLD, &world_group);
+  MPI_Group_incl(world_group, 1, &target, &w->target_group);
+  MPI_Group_incl(world_group, 1, &origin, &w->origin_group);
+  MPI_Group_free(&world_group);
+  if(sync == rma_lock)
+    MPI_Win_lock_all(0, w->win);
+  else if(sync == rma_fence)
+    MPI_Win_fence(MPI_MODE_NOPRECEDE, w->win);
+  return MPI_SUCCESS;
+}
+
+void
+rma_win_free(struct rma_win *w)
+{
+  if(w->sync == rma_lock)
+    MPI_Win_unlock_all(w->win);
+  else if(w->sync == rma_fence)
+    MPI_Win_fence(MPI_MODE_NOSUCCEED, w->win);
+  MPI_Group_free(&w->target_group);
+  MPI_Group_free(&w->origin_group);
+  MPI_Win_free(&w->win);
+}
+
+static inline void
+epoch_begin(struct rma_win *w)
+{
+  switch(w->sync) {
+    case rma_fence:
+      MPI_Win_fence(0, w->win);
+      break;
+    case rma_lock:
+      break;
+    case rma_pscw:
+      MPI_Win_post(w->origin_group, 0, w->win);
+      MPI_Win_start(w->target_group, 0, w->win);
+      break;
+  }
+}
+
+static inline void
+epoch_end(struct rma_win *w)
+{
+  switch(w->sync) {
+    case rma_fence:
+      MPI_Win_fence(0, w->win);
+      break;
+    case rma_lock:
+      MPI_Win_flush(w->target, w->win);
+      break;
+    case rma_pscw:
+      MPI_Win_complete(w->win);
+      MPI_Win_wait(w->win);
+      break;
+  }
+}
+
+void
+rma_func(struct rma_win *w, struct msg_buf *buf, uint64_t *snd_time,
+	 uint64_t *sync_time, int tag, enum rma_op op, unsigned int nr_ops)
+{
+  const size_t msg_size = buf->msg_size;
+  char *data = msg_buf_get(buf);
+  /* every get of an epoch needs its own origin block */
+  char *rdata = op == rma_op_get ? msg_buf_get_recv(buf, (size_t) nr_ops * msg_size) : NULL;
+  uint64_t time_start, time_end;
+
+  if(msg_size > INT_MAX) {
+    fprintf(stderr, "Message size %zu is too large for RMA on rank %i\n",
+        msg_size, world_rank);
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
+  msg_header_write(data, msg_size, tag);
+  if(tag == -1) {
+    msg_fill_random(data, msg_size);
+  }
+
+  time_start = timer_read();
+  epoch_begin(w);
+  for(unsigned int i = 0; i < nr_ops; i++) {
+    MPI_Aint disp = (MPI_Aint) i * msg_size;
+    switch(op) {
+      case rma_op_put:
+        MPI_Put(data, msg_size, MPI_BYTE, w->target, disp, msg_size, MPI_BYTE, w->win);
+        break;
+      case rma_op_get:
+        MPI_Get(rdata + disp, msg_size, MPI_BYTE, w->target, disp, msg_size, MPI_BYTE,
+            w->win);
+        break;
+      case rma_op_acc:
+        MPI_Accumulate(data, msg_size / sizeof(int), MPI_INT, w->target, disp,
+            msg_size / sizeof(int), MPI_INT, MPI_SUM, w->win);
+        break;
+    }
+  }
+  epoch_end(w);
+  time_end = timer_read();
+  *snd_time = leg_done(leg_snd, time_start, time_end);
+
+  time_start = timer_read();
+  epoch_begin(w);
+  epoch_end(w);
+  time_end = timer_read();
+  *sync_time = leg_done(leg_prb, time_start, time_end);
+
+  if(rdata)
+    msg_buf_put(buf, rdata);
+  msg_buf_put(buf, data);
+}
@@ -0,0 +1,60 @@
+#ifndef RMA_H
+#define RMA_H
+
+#include <stdint.h>
+#include <mpi.h>
+
+#include "mpi_tests.h"
+
+/*
+ * One-sided communication on a window from MPI_Win_allocate(). Every
+ * rank accesses the window of one target, the next rank in the ring or
+ * its even/odd partner, and exposes its own to the rank which targets
+ * it. The access epochs are synchronized with
+ *
+ *   fence  MPI_Win_fence() before and after the operations
+ *   lock   MPI_Win_lock_all() for the whole window lifetime, every epoch
+ *          ends with MPI_Win_flush() of the target
+ *   pscw   MPI_Win_post()/MPI_Win_start(), MPI_Win_complete()/MPI_Win_wait()
+ */
+enum rma_sync {
+  rma_fence,
+  rma_lock,
+  rma_pscw,
+};
+
+enum rma_op {
+  rma_op_put,
+  rma_op_get,
+  rma_op_acc,
+};
+
+struct rma_win {
+  MPI_Win win;
+  void *base;
+  enum rma_sync sync;
+  int target;
+  /* the target and the rank targeting this one, for pscw */
+  MPI_Group target_group;
+  MPI_Group origin_group;
+};
+
+/* "fence", "lock" or "pscw", returns -1 for anything else */
+int rma_parse_sync(const char *name, enum rma_sync *sync);
+
+/* window of size bytes, collective over MPI_COMM_WORLD */
+int rma_win_init(struct rma_win *w, size_t size, int target, int origin,
+    enum rma_sync sync);
+void rma_win_free(struct rma_win *w);
+
+/*
+ * nr_ops operations of buf->msg_size bytes to consecutive blocks of the
+ * target window in one epoch, the epoch is the snd leg. The same epoch
+ * without any operation, the cost of the synchronization alone, is the
+ * prb leg. Accumulate sums MPI_INT, get reads into consecutive blocks of
+ * the receive buffer of buf.
+ */
+void rma_func(struct rma_win *w, struct msg_buf *buf, uint64_t *snd_time,
+    uint64_t *sync_time, int tag, enum rma_op op, unsigned int nr_ops);
+
+#endif
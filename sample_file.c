@@ -0,0 +1,104 @@
+#include "sample_file.h"
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+extern int world_rank;
+extern int world_size;
+
+struct sample_file {
+  MPI_File fh;
+  struct sample_file_header header;
+};
+
+struct sample_file *
+sample_file_open(const char *path,
+		 const char *mode,
+		 const size_t *sizes,
+		 unsigned int nr_sizes,
+		 uint64_t nr_runs,
+		 const char *host)
+{
+  struct sample_file *file = calloc(1, sizeof(struct sample_file));
+  char host_entry[SAMPLE_FILE_HOST_LEN] = { 0 };
+  MPI_Offset offset;
+
+  if(file == NULL)
+    return NULL;
+  if(MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+		   MPI_INFO_NULL, &file->fh) != MPI_SUCCESS) {
+    free(file);
+    return NULL;
+  }
+  MPI_File_set_size(file->fh, 0);
+
+  memcpy(file->header.magic, SAMPLE_FILE_MAGIC, sizeof(file->header.magic));
+  file->header.version = SAMPLE_FILE_VERSION;
+  file->header.nr_ranks = world_size;
+  file->header.nr_sizes = nr_sizes;
+  file->header.nr_legs = SAMPLE_FILE_LEGS;
+  file->header.nr_runs = nr_runs;
+  strncpy(file->header.mode, mode, SAMPLE_FILE_MODE_LEN - 1);
+
+  if(world_rank == 0) {
+    uint64_t *sizes64 = malloc(nr_sizes * sizeof(uint64_t));
+    for(unsigned int i = 0; i < nr_sizes; i++)
+      sizes64[i] = sizes[i];
+    MPI_File_write_at(file->fh, 0, &file->header, sizeof(file->header),
+		      MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_write_at(file->fh, sizeof(file->header), sizes64,
+		      nr_sizes * sizeof(uint64_t), MPI_BYTE, MPI_STATUS_IGNORE);
+    free(sizes64);
+  }
+
+  /* every rank puts its own host name into the rank map */
+  strncpy(host_entry, host, SAMPLE_FILE_HOST_LEN - 1);
+  offset = sizeof(file->header) + nr_sizes * sizeof(uint64_t) +
+    (MPI_Offset) world_rank * SAMPLE_FILE_HOST_LEN;
+  MPI_File_write_at_all(file->fh, offset, host_entry, SAMPLE_FILE_HOST_LEN,
+			MPI_BYTE, MPI_STATUS_IGNORE);
+
+  return file;
+}
+
+int
+sample_file_write(struct sample_file *file,
+		  unsigned int step,
+		  const uint64_t *samples)
+{
+  MPI_Offset offset = sample_file_block_offset(&file->header, step, world_rank);
+  uint64_t count = file->header.nr_legs * file->header.nr_runs;
+
+  /* the block of a rank may exceed an int count for large -t */
+#if MPI_VERSION >= 4
+  return MPI_File_write_at_all_c(file->fh, offset, samples, (MPI_Count) count,
+				 MPI_UINT64_T, MPI_STATUS_IGNORE);
+#else
+  MPI_Datatype runs;
+  int ret;
+
+  if(count <= INT_MAX)
+    return MPI_File_write_at_all(file->fh, offset, samples, (int) count,
+				 MPI_UINT64_T, MPI_STATUS_IGNORE);
+  /* otherwise one element of nr_runs samples per leg */
+  if(file->header.nr_runs > INT_MAX)
+    return MPI_ERR_COUNT;
+  MPI_Type_contiguous((int) file->header.nr_runs, MPI_UINT64_T, &runs);
+  MPI_Type_commit(&runs);
+  ret = MPI_File_write_at_all(file->fh, offset, samples, (int) file->header.nr_legs,
+			      runs, MPI_STATUS_IGNORE);
+  MPI_Type_free(&runs);
+  return ret;
+#endif
+}
+
+void
+sample_file_close(struct sample_file *file)
+{
+  if(file == NULL)
+    return;
+  MPI_File_close(&file->fh);
+  free(file);
+}
@@ -0,0 +1,64 @@
+#ifndef SAMPLE_FILE_H
+#define SAMPLE_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Binary file with the time evolution (-e) of all ranks, written by all
+ * ranks in parallel with MPI-IO. The layout is
+ *
+ *   struct sample_file_header
+ *   uint64_t sizes[nr_sizes]                      message size of every step
+ *   char hosts[nr_ranks][SAMPLE_FILE_HOST_LEN]    processor name of every rank
+ *   for every step, for every rank:
+ *     uint64_t samples[nr_legs][nr_runs]          snd, rcv and prb in ns
+ *
+ * in the byte order of the machine which wrote it. mpi_timing_conv turns
+ * it into the text output of -e.
+ */
+#define SAMPLE_FILE_MAGIC "MPITIMNG"
+#define SAMPLE_FILE_VERSION 2
+#define SAMPLE_FILE_HOST_LEN 256
+#define SAMPLE_FILE_MODE_LEN 32
+#define SAMPLE_FILE_LEGS 3
+
+struct sample_file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t nr_ranks;
+  uint32_t nr_sizes;
+  uint32_t nr_legs;
+  uint64_t nr_runs;
+  char mode[SAMPLE_FILE_MODE_LEN];
+};
+
+static inline uint64_t
+sample_file_block_size(const struct sample_file_header *header)
+{
+  return header->nr_legs * header->nr_runs * sizeof(uint64_t);
+}
+
+static inline uint64_t
+sample_file_block_offset(const struct sample_file_header *header,
+			 unsigned int step, unsigned int rank)
+{
+  return sizeof(struct sample_file_header) +
+    header->nr_sizes * sizeof(uint64_t) +
+    (uint64_t) header->nr_ranks * SAMPLE_FILE_HOST_LEN +
+    ((uint64_t) step * header->nr_ranks + rank) * sample_file_block_size(header);
+}
+
+struct sample_file;
+
+/* collective, creates path and writes header, sizes and host names */
+struct sample_file *sample_file_open(const char *path, const char *mode,
+    const size_t *sizes, unsigned int nr_sizes, uint64_t nr_runs,
+    const char *host);
+/* collective, nr_legs * nr_runs samples of this rank for step */
+int sample_file_write(struct sample_file *file, unsigned int step,
+    const uint64_t *samples);
+/* collective */
+void sample_file_close(struct sample_file *file);
+
+#endif
@@ -0,0 +1,333 @@
+#include "stats.h"
+#include <math.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static inline unsigned int
+stats_hist_index(uint64_t v)
+{
+  if(v < STATS_SUB_BUCKETS)
+    return v;
+  /* v is in [2^e, 2^(e+1)), keep the STATS_SUB_BITS bits below the leading one */
+  unsigned int shift = 63 - __builtin_clzll(v) - STATS_SUB_BITS;
+  return ((shift + 1) << STATS_SUB_BITS) + (v >> shift) - STATS_SUB_BUCKETS;
+}
+
+/* middle of the range of values which end up in bucket index */
+static inline double
+stats_hist_value(unsigned int index)
+{
+  if(index < STATS_SUB_BUCKETS)
+    return index;
+  unsigned int shift = (index >> STATS_SUB_BITS) - 1;
+  uint64_t low = (uint64_t) ((index & (STATS_SUB_BUCKETS - 1)) + STATS_SUB_BUCKETS) << shift;
+  return low + ((uint64_t) 1 << shift) / 2.0;
+}
+
+void
+stats_init(struct stats *s)
+{
+  memset(s, 0, sizeof(*s));
+}
+
+void
+stats_add(struct stats *s, uint64_t x)
+{
+  double delta = x - s->mean;
+
+  s->n++;
+  s->mean += delta / s->n;
+  s->m2 += delta * (x - s->mean);
+  if(s->n == 1 || x < s->min)
+    s->min = x;
+  if(s->n == 1 || x > s->max)
+    s->max = x;
+  s->hist[stats_hist_index(x)]++;
+}
+
+double
+stats_mean(const struct stats *s)
+{
+  return s->mean;
+}
+
+double
+stats_variance(const struct stats *s)
+{
+  return s->n > 1 ? s->m2 / (s->n - 1) : 0;
+}
+
+double
+stats_percentile(const struct stats *s, double p)
+{
+  uint64_t rank, count = 0;
+  double value;
+
+  if(s->n == 0)
+    return 0;
+  rank = ceil(p / 100 * s->n);
+  if(rank == 0)
+    rank = 1;
+  for(unsigned int i = 0; i < STATS_HIST_BUCKETS; i++) {
+    count += s->hist[i];
+    if(count >= rank) {
+      value = stats_hist_value(i);
+      /* the bucket middle may lie outside of what was measured */
+      if(value < s->min)
+        value = s->min;
+      if(value > s->max)
+        value = s->max;
+      return value;
+    }
+  }
+  return s->max;
+}
+
+void
+stats_merge(struct stats *a, const struct stats *b)
+{
+  if(b->n == 0)
+    return;
+  if(a->n == 0) {
+    *a = *b;
+    return;
+  }
+
+  /* Chan et al., pairwise update of mean and sum of squares */
+  uint64_t n = a->n + b->n;
+  double delta = b->mean - a->mean;
+
+  a->mean += delta * b->n / n;
+  a->m2 += b->m2 + delta * delta * a->n * b->n / n;
+  a->n = n;
+  if(b->min < a->min)
+    a->min = b->min;
+  if(b->max > a->max)
+    a->max = b->max;
+  for(unsigned int i = 0; i < STATS_HIST_BUCKETS; i++)
+    a->hist[i] += b->hist[i];
+}
+
+static void
+stats_merge_op(void *in, void *inout, int *len, MPI_Datatype *type)
+{
+  const struct stats *b = in;
+  struct stats *a = inout;
+
+  (void) type;
+  for(int i = 0; i < *len; i++)
+    stats_merge(&a[i], &b[i]);
+}
+
+int
+stats_reduce(const struct stats *in, struct stats *out, int count,
+	     int root, MPI_Comm comm)
+{
+  MPI_Datatype type;
+  MPI_Op op;
+  int ret;
+
+  MPI_Type_contiguous(sizeof(struct stats), MPI_BYTE, &type);
+  MPI_Type_commit(&type);
+  MPI_Op_create(stats_merge_op, 1, &op);
+  ret = MPI_Reduce(in, out, count, type, op, root, comm);
+  MPI_Op_free(&op);
+  MPI_Type_free(&type);
+  return ret;
+}
+
+/* sums relative to shift, accumulated by the different implementations */
+struct stats_sums {
+  uint64_t min;
+  uint64_t max;
+  int64_t sum;
+  double sumsq;
+};
+
+static void
+stats_sums_scalar(const uint64_t *x, size_t n, uint64_t shift, struct stats_sums *r)
+{
+  for(size_t i = 0; i < n; i++) {
+    int64_t d = x[i] - shift;
+    if(x[i] < r->min)
+      r->min = x[i];
+    if(x[i] > r->max)
+      r->max = x[i];
+    r->sum += d;
+    r->sumsq += (double) d * d;
+  }
+}
+
+#if defined(__x86_64__)
+/*
+ * int64 to double without AVX-512DQ: adding d to the bits of 2^52 + 2^51
+ * gives the double 2^52 + 2^51 + d for |d| < 2^51
+ */
+#define STATS_MAGIC 0x1.8p52
+
+__attribute__((target("avx2,fma"))) static size_t
+stats_sums_avx2(const uint64_t *x, size_t n, uint64_t shift, struct stats_sums *r)
+{
+  __m256i vmin = _mm256_set1_epi64x(r->min), vmax = _mm256_set1_epi64x(r->max);
+  __m256i vsum = _mm256_setzero_si256(), vshift = _mm256_set1_epi64x(shift);
+  __m256d vsumsq = _mm256_setzero_pd(), vmagic = _mm256_set1_pd(STATS_MAGIC);
+  __m256i vmagic_bits = _mm256_castpd_si256(vmagic);
+  int64_t tmp[4];
+  double tmpd[4];
+  size_t i;
+
+  for(i = 0; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) &x[i]);
+    __m256i d = _mm256_sub_epi64(v, vshift);
+    __m256d dd = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(d, vmagic_bits)), vmagic);
+    /* the samples are below 2^63, signed compares do */
+    vmin = _mm256_blendv_epi8(vmin, v, _mm256_cmpgt_epi64(vmin, v));
+    vmax = _mm256_blendv_epi8(vmax, v, _mm256_cmpgt_epi64(v, vmax));
+    vsum = _mm256_add_epi64(vsum, d);
+    vsumsq = _mm256_fmadd_pd(dd, dd, vsumsq);
+  }
+  _mm256_storeu_si256((__m256i *) tmp, vmin);
+  for(unsigned int k = 0; k < 4; k++)
+    if((uint64_t) tmp[k] < r->min)
+      r->min = tmp[k];
+  _mm256_storeu_si256((__m256i *) tmp, vmax);
+  for(unsigned int k = 0; k < 4; k++)
+    if((uint64_t) tmp[k] > r->max)
+      r->max = tmp[k];
+  _mm256_storeu_si256((__m256i *) tmp, vsum);
+  r->sum += tmp[0] + tmp[1] + tmp[2] + tmp[3];
+  _mm256_storeu_pd(tmpd, vsumsq);
+  r->sumsq += tmpd[0] + tmpd[1] + tmpd[2] + tmpd[3];
+  return i;
+}
+
+__attribute__((target("avx512f"))) static size_t
+stats_sums_avx512(const uint64_t *x, size_t n, uint64_t shift, struct stats_sums *r)
+{
+  __m512i vmin = _mm512_set1_epi64(r->min), vmax = _mm512_set1_epi64(r->max);
+  __m512i vsum = _mm512_setzero_si512(), vshift = _mm512_set1_epi64(shift);
+  __m512d vsumsq = _mm512_setzero_pd(), vmagic = _mm512_set1_pd(STATS_MAGIC);
+  __m512i vmagic_bits = _mm512_castpd_si512(vmagic);
+  uint64_t tmp;
+  size_t i;
+
+  for(i = 0; i + 8 <= n; i += 8) {
+    __m512i v = _mm512_loadu_si512(&x[i]);
+    __m512i d = _mm512_sub_epi64(v, vshift);
+    __m512d dd = _mm512_sub_pd(_mm512_castsi512_pd(_mm512_add_epi64(d, vmagic_bits)), vmagic);
+    vmin = _mm512_min_epu64(vmin, v);
+    vmax = _mm512_max_epu64(vmax, v);
+    vsum = _mm512_add_epi64(vsum, d);
+    vsumsq = _mm512_fmadd_pd(dd, dd, vsumsq);
+  }
+  tmp = _mm512_reduce_min_epu64(vmin);
+  if(tmp < r->min)
+    r->min = tmp;
+  tmp = _mm512_reduce_max_epu64(vmax);
+  if(tmp > r->max)
+    r->max = tmp;
+  r->sum += _mm512_reduce_add_epi64(vsum);
+  r->sumsq += _mm512_reduce_add_pd(vsumsq);
+  return i;
+}
+#endif
+
+void
+stats_summary(const uint64_t *x, size_t n, struct stats_summary *out)
+{
+  struct stats_sums r;
+  size_t done = 0;
+
+  if(n == 0) {
+    memset(out, 0, sizeof(*out));
+    return;
+  }
+  r.min = r.max = x[0];
+  r.sum = 0;
+  r.sumsq = 0;
+
+#if defined(__x86_64__)
+  if(__builtin_cpu_supports("avx512f"))
+    done = stats_sums_avx512(x, n, x[0], &r);
+  else if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    done = stats_sums_avx2(x, n, x[0], &r);
+#endif
+  stats_sums_scalar(x + done, n - done, x[0], &r);
+
+  out->min = r.min;
+  out->max = r.max;
+  out->mean = x[0] + (double) r.sum / n;
+  out->variance = n > 1 ? (r.sumsq - (double) r.sum * r.sum / n) / (n - 1) : 0;
+  if(out->variance < 0)
+    out->variance = 0;
+}
+
+uint64_t
+stats_select(uint64_t *x, size_t n, size_t k)
+{
+  size_t left = 0, right = n - 1;
+
+  while(left < right) {
+    /* median of three as pivot, Hoare partition */
+    size_t mid = left + (right - left) / 2;
+    uint64_t a = x[left], b = x[mid], c = x[right];
+    uint64_t pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+    size_t i = left, j = right;
+
+    while(i <= j) {
+      while(x[i] < pivot)
+        i++;
+      while(x[j] > pivot)
+        j--;
+      if(i <= j) {
+        uint64_t t = x[i];
+        x[i] = x[j];
+        x[j] = t;
+        i++;
+        if(j == 0)
+          break;
+        j--;
+      }
+    }
+    if(k <= j)
+      right = j;
+    else if(k >= i)
+      left = i;
+    else
+      return x[k];
+  }
+  return x[k];
+}
+
+double
+stats_median(uint64_t *x, size_t n)
+{
+  if(n == 0)
+    return 0;
+  uint64_t upper = stats_select(x, n, n / 2);
+  if(n % 2)
+    return upper;
+  /* the lower middle is the largest element left of n / 2 */
+  uint64_t lower = x[0];
+  for(size_t i = 1; i < n / 2; i++)
+    if(x[i] > lower)
+      lower = x[i];
+  return (lower + upper) / 2.0;
+}
+
+uint64_t
+stats_array_percentile(uint64_t *x, size_t n, double p)
+{
+  size_t rank;
+
+  if(n == 0)
+    return 0;
+  rank = ceil(p / 100 * n);
+  if(rank == 0)
+    rank = 1;
+  if(rank > n)
+    rank = n;
+  return stats_select(x, n, rank - 1);
+}
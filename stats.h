@@ -0,0 +1,67 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mpi.h>
+
+/*
+ * Online statistics with constant memory: Welford mean/variance, min,
+ * max and a log-linear histogram of the samples for the
+ * median and the tail percentiles. Every power of two is split into
+ * STATS_SUB_BUCKETS buckets, so the relative error of a percentile is
+ * below 1/STATS_SUB_BUCKETS, values below STATS_SUB_BUCKETS ns are exact.
+ * The statistics of several ranks can be merged with stats_reduce(), the
+ * result is the same as if all samples had been added on one rank.
+ * All samples and results are in nanoseconds.
+ */
+#define STATS_SUB_BITS 7
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BITS)
+#define STATS_HIST_BUCKETS ((64 - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS)
+
+struct stats {
+  uint64_t n;
+  double mean;
+  /* sum of squared differences from the mean */
+  double m2;
+  uint64_t min;
+  uint64_t max;
+  uint64_t hist[STATS_HIST_BUCKETS];
+};
+
+void stats_init(struct stats *s);
+/* add a sample, 0 ns is a valid one */
+void stats_add(struct stats *s, uint64_t x);
+double stats_mean(const struct stats *s);
+/* sample variance, like gsl_stats_variance() */
+double stats_variance(const struct stats *s);
+/* p-th percentile (0 < p <= 100) from the histogram */
+double stats_percentile(const struct stats *s, double p);
+/* merge b into a */
+void stats_merge(struct stats *a, const struct stats *b);
+/* merge count statistics of all ranks of comm into out on root */
+int stats_reduce(const struct stats *in, struct stats *out, int count,
+    int root, MPI_Comm comm);
+
+/*
+ * Exact statistics of an array of samples, computed in a single
+ * vectorized pass (AVX-512, AVX2 or scalar, picked at runtime). The sum
+ * is exact, the squares are taken relative to the first sample to keep
+ * the variance stable. Samples must be below 2^51.
+ */
+struct stats_summary {
+  uint64_t min;
+  uint64_t max;
+  double mean;
+  double variance;
+};
+
+void stats_summary(const uint64_t *x, size_t n, struct stats_summary *out);
+/* k-th smallest element (0 based), reorders x */
+uint64_t stats_select(uint64_t *x, size_t n, size_t k);
+/* median like gsl_stats_median_from_sorted_data(), reorders x */
+double stats_median(uint64_t *x, size_t n);
+/* nearest rank p-th percentile, reorders x */
+uint64_t stats_array_percentile(uint64_t *x, size_t n, double p);
+
+#endif
@@ -0,0 +1,112 @@
+#include "thread_rate.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mpi_tests.h"
+
+struct rate_thread {
+  pthread_t thread;
+  MPI_Comm comm;
+  struct msg_buf buf;
+  unsigned int nr_runs;
+  unsigned int window;
+  struct stats *stats;
+};
+
+static MPI_Comm *thread_comms;
+static unsigned int nr_thread_comms;
+
+int
+thread_rate_init(unsigned int max_threads)
+{
+  thread_comms = malloc(max_threads * sizeof(MPI_Comm));
+  if(thread_comms == NULL)
+    return -1;
+  for(nr_thread_comms = 0; nr_thread_comms < max_threads; nr_thread_comms++)
+    MPI_Comm_dup(MPI_COMM_WORLD, &thread_comms[nr_thread_comms]);
+  return 0;
+}
+
+void
+thread_rate_free(void)
+{
+  for(unsigned int t = 0; t < nr_thread_comms; t++)
+    MPI_Comm_free(&thread_comms[t]);
+  free(thread_comms);
+  thread_comms = NULL;
+  nr_thread_comms = 0;
+}
+
+/* send_bw on the communicator of the thread, see send_bw_func() */
+static void *
+rate_thread_main(void *arg)
+{
+  struct rate_thread *t = arg;
+  const size_t msg_size = t->buf.msg_size;
+  const int sender = world_rank % 2 == 0;
+  const int partner = sender ? world_rank + 1 : world_rank - 1;
+  unsigned int nr_reqs = msg_nr_requests(msg_size);
+  MPI_Request *reqs = msg_buf_reqs(&t->buf, t->window * nr_reqs);
+  char *data = msg_buf_get(&t->buf);
+
+  msg_header_write(data, msg_size, 0);
+  for(unsigned int i = 0; i < t->nr_runs; i++) {
+    uint64_t time_start = timer_read();
+    for(unsigned int w = 0; w < t->window; w++) {
+      if(sender)
+        msg_isend(data, msg_size, partner, MAGIC_ID, t->comm, &reqs[w * nr_reqs]);
+      else
+        msg_irecv(data, msg_size, partner, MAGIC_ID, t->comm, &reqs[w * nr_reqs]);
+    }
+    MPI_Waitall(t->window * nr_reqs, reqs, MPI_STATUSES_IGNORE);
+    if(sender)
+      MPI_Recv(NULL, 0, MPI_BYTE, partner, MAGIC_ID + 1, t->comm, MPI_STATUS_IGNORE);
+    else
+      MPI_Send(NULL, 0, MPI_BYTE, partner, MAGIC_ID + 1, t->comm);
+    stats_add(t->stats, timer_elapsed(time_start, timer_read()));
+  }
+  msg_buf_put(&t->buf, data);
+  return NULL;
+}
+
+int
+thread_rate_run(size_t msg_size, unsigned int nr_threads, unsigned int nr_runs,
+		unsigned int window, unsigned prefault, unsigned fresh, struct stats *stats)
+{
+  struct rate_thread *threads = calloc(nr_threads, sizeof(struct rate_thread));
+
+  assert(world_size % 2 == 0);
+  assert(nr_threads <= nr_thread_comms);
+  if(threads == NULL)
+    return -1;
+  for(unsigned int t = 0; t < nr_threads; t++) {
+    threads[t].comm = thread_comms[t];
+    threads[t].nr_runs = nr_runs;
+    threads[t].window = window;
+    threads[t].stats = &stats[t];
+    stats_init(&stats[t]);
+    if(msg_buf_init(&threads[t].buf, msg_size, prefault, fresh) != 0) {
+      fprintf(stderr, "Could not allocate message buffer of size %zu on rank %i\n",
+	      msg_size, world_rank);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+  }
+
+  /* all threads of all ranks start together */
+  MPI_Barrier(MPI_COMM_WORLD);
+  for(unsigned int t = 0; t < nr_threads; t++) {
+    if(pthread_create(&threads[t].thread, NULL, rate_thread_main, &threads[t]) != 0) {
+      fprintf(stderr, "Could not start thread %u on rank %i\n", t, world_rank);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+  }
+  for(unsigned int t = 0; t < nr_threads; t++)
+    pthread_join(threads[t].thread, NULL);
+
+  for(unsigned int t = 0; t < nr_threads; t++)
+    msg_buf_free(&threads[t].buf);
+  free(threads);
+  return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef THREAD_RATE_H
+#define THREAD_RATE_H
+
+#include <stdint.h>
+#include <mpi.h>
+
+#include "stats.h"
+
+/*
+ * Message rate with several threads per rank, MPI has to be initialized
+ * with MPI_THREAD_MULTIPLE. Every thread runs the send_bw pattern between
+ * the even rank and its odd partner on a communicator of its own, so the
+ * threads only share the MPI library and whatever locks it takes.
+ */
+
+/* duplicate MPI_COMM_WORLD for up to max_threads threads, collective */
+int thread_rate_init(unsigned int max_threads);
+void thread_rate_free(void);
+
+/*
+ * nr_runs windows of window messages of msg_size bytes on each of
+ * nr_threads threads, the times of a window in ns go to stats[t] of
+ * thread t. Collective over MPI_COMM_WORLD, world_size has to be even.
+ */
+int thread_rate_run(size_t msg_size, unsigned int nr_threads, unsigned int nr_runs,
+    unsigned int window, unsigned prefault, unsigned fresh, struct stats *stats);
+
+#endif
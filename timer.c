@@ -0,0 +1,112 @@
+#include "timer.h"
+#include <string.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+/* reads for the resolution and overhead measurement */
+#define TIMER_CALIBRATION_READS 10000
+/* how long the TSC is compared with CLOCK_MONOTONIC_RAW */
+#define TIMER_CALIBRATION_NS (50 * 1000 * 1000ULL)
+
+struct timer timer = {
+  .source = timer_monotonic,
+  .name = "monotonic",
+  .mult = 1ULL << 32,
+  .ns_per_tick = 1,
+};
+
+int
+timer_parse_source(const char *name, enum timer_source *source)
+{
+  if(strcmp(name, "monotonic") == 0)
+    *source = timer_monotonic;
+  else if(strcmp(name, "monotonic_raw") == 0)
+    *source = timer_monotonic_raw;
+  else if(strcmp(name, "tsc") == 0)
+    *source = timer_tsc;
+  else if(strcmp(name, "mpi") == 0)
+    *source = timer_mpi;
+  else
+    return -1;
+  return 0;
+}
+
+#if defined(__x86_64__)
+static int
+tsc_is_invariant(void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  if(__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000007)
+    return 0;
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  return (edx >> 8) & 1;
+}
+
+/* length of a TSC tick in ns, measured against CLOCK_MONOTONIC_RAW */
+static double
+tsc_ns_per_tick(void)
+{
+  unsigned int aux;
+  uint64_t ns_start, ns_end, tsc_start, tsc_end;
+
+  ns_start = timer_clock_ns(CLOCK_MONOTONIC_RAW);
+  tsc_start = __rdtscp(&aux);
+  do {
+    ns_end = timer_clock_ns(CLOCK_MONOTONIC_RAW);
+    tsc_end = __rdtscp(&aux);
+  } while(ns_end - ns_start < TIMER_CALIBRATION_NS);
+  return (double) (ns_end - ns_start) / (tsc_end - tsc_start);
+}
+#endif
+
+int
+timer_init(enum timer_source source, unsigned subtract_overhead)
+{
+  static const char *names[] = { "monotonic", "monotonic_raw", "tsc", "mpi" };
+  uint64_t min_step = UINT64_MAX, start, ticks;
+
+  timer.source = source;
+  timer.name = names[source];
+  timer.ns_per_tick = 1;
+  timer.subtract = 0;
+  switch(source) {
+    case timer_tsc:
+#if defined(__x86_64__)
+      if(!tsc_is_invariant())
+        return -1;
+      timer.ns_per_tick = tsc_ns_per_tick();
+      break;
+#else
+      return -1;
+#endif
+    case timer_mpi:
+      timer.wtime_base = MPI_Wtime();
+      break;
+    default:
+      break;
+  }
+  timer.mult = timer.ns_per_tick * (1ULL << 32);
+
+  /* the smallest non-zero difference of two reads is the resolution */
+  for(unsigned int i = 0; i < TIMER_CALIBRATION_READS; i++) {
+    uint64_t t1 = timer_read();
+    uint64_t t2 = timer_read();
+    if(t2 > t1 && t2 - t1 < min_step)
+      min_step = t2 - t1;
+  }
+  timer.resolution = min_step == UINT64_MAX ? 0 : min_step * timer.ns_per_tick;
+  if(source == timer_mpi && MPI_Wtick() * 1e9 > timer.resolution)
+    timer.resolution = MPI_Wtick() * 1e9;
+
+  /* an interval contains about the cost of one read */
+  start = timer_read();
+  for(unsigned int i = 0; i < TIMER_CALIBRATION_READS; i++)
+    timer_read();
+  ticks = (timer_read() - start) / (TIMER_CALIBRATION_READS + 1);
+  timer.overhead = ticks * timer.ns_per_tick;
+  if(subtract_overhead)
+    timer.subtract = ticks;
+  return 0;
+}
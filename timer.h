@@ -0,0 +1,101 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <time.h>
+#include <mpi.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#define NSEC_PER_SEC 1000000000ULL
+
+/*
+ * Timer used by the kernels. timer_read() returns ticks of the selected
+ * source, timer_elapsed() turns the difference of two reads into
+ * nanoseconds, so the conversion stays out of the timed region.
+ *
+ *   monotonic      CLOCK_MONOTONIC, the default
+ *   monotonic_raw  CLOCK_MONOTONIC_RAW, not slewed by NTP
+ *   tsc            rdtscp, needs an invariant TSC, calibrated at startup
+ *   mpi            MPI_Wtime()
+ */
+enum timer_source {
+  timer_monotonic,
+  timer_monotonic_raw,
+  timer_tsc,
+  timer_mpi,
+};
+
+struct timer {
+  enum timer_source source;
+  const char *name;
+  /* ns = ticks * mult >> 32 */
+  uint64_t mult;
+  double ns_per_tick;
+  /* smallest step seen between two reads, in ns */
+  double resolution;
+  /* cost of one read, in ns */
+  double overhead;
+  /* ticks taken off every interval, the read overhead with --subtract-overhead */
+  uint64_t subtract;
+  /* MPI_Wtime() at timer_init(), keeps the ns of the mpi source small */
+  double wtime_base;
+};
+
+extern struct timer timer;
+
+/* "monotonic", "monotonic_raw", "tsc" or "mpi", returns -1 for anything else */
+int timer_parse_source(const char *name, enum timer_source *source);
+/*
+ * select and calibrate the source, needs MPI to be initialized for the
+ * mpi source, returns -1 if the source isn't usable on this machine
+ */
+int timer_init(enum timer_source source, unsigned subtract_overhead);
+
+static inline uint64_t
+timer_clock_ns(clockid_t clock)
+{
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+  return (uint64_t) ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static inline uint64_t
+timer_read(void)
+{
+  switch(timer.source) {
+#if defined(__x86_64__)
+    case timer_tsc: {
+      unsigned int aux;
+      return __rdtscp(&aux);
+    }
+#endif
+    case timer_monotonic_raw:
+      return timer_clock_ns(CLOCK_MONOTONIC_RAW);
+    case timer_mpi:
+      return (MPI_Wtime() - timer.wtime_base) * 1e9;
+    default:
+      return timer_clock_ns(CLOCK_MONOTONIC);
+  }
+}
+
+/* ticks of timer_read() as ns since some arbitrary point */
+static inline uint64_t
+timer_ns(uint64_t ticks)
+{
+  return ((unsigned __int128) ticks * timer.mult) >> 32;
+}
+
+/* ns between two reads */
+static inline uint64_t
+timer_elapsed(uint64_t start, uint64_t end)
+{
+  uint64_t ticks = end - start;
+
+  ticks = ticks > timer.subtract ? ticks - timer.subtract : 0;
+  return ((unsigned __int128) ticks * timer.mult) >> 32;
+}
+
+#endif
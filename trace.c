@@ -0,0 +1,107 @@
+#include "trace.h"
+#include "timer.h"
+#include "clock_sync.h"
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+extern int world_rank;
+extern int world_size;
+
+/* longest JSON line of one event */
+#define TRACE_LINE_LEN 256
+
+static const char *trace_leg_names[3] = { "snd", "rcv", "prb" };
+
+int
+trace_init(struct trace *t, size_t nr_events)
+{
+  t->nr_events = nr_events ? nr_events : 1;
+  t->next = 0;
+  t->events = calloc(t->nr_events, sizeof(struct trace_event));
+  return t->events == NULL ? -1 : 0;
+}
+
+void
+trace_free(struct trace *t)
+{
+  free(t->events);
+  t->events = NULL;
+}
+
+static uint64_t
+trace_ns(uint64_t ticks, unsigned global)
+{
+  uint64_t ns = timer_ns(ticks);
+  return global ? clock_global(ns) : ns;
+}
+
+int
+trace_write(struct trace *t, const char *path, const char *mode,
+	    unsigned global)
+{
+  uint64_t first = t->next > t->nr_events ? t->next - t->nr_events : 0;
+  uint64_t start = UINT64_MAX, offset = 0, len = 0, max_len;
+  MPI_File fh;
+  char *buf;
+  int ret;
+
+  /*
+   * every timeline starts at the earliest event of all ranks, the events
+   * aren't recorded in the order they began, e.g. rcv before snd
+   */
+  for(uint64_t i = first; i < t->next; i++) {
+    uint64_t begin = trace_ns(t->events[i % t->nr_events].begin, global);
+    if(begin < start)
+      start = begin;
+  }
+  MPI_Allreduce(MPI_IN_PLACE, &start, 1, MPI_UINT64_T, MPI_MIN, MPI_COMM_WORLD);
+
+  buf = malloc((t->next - first + 2) * TRACE_LINE_LEN);
+  if(buf == NULL)
+    return -1;
+  if(world_rank == 0)
+    len += sprintf(buf + len, "{\"traceEvents\":[\n");
+  len += sprintf(buf + len, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%i,"
+		 "\"args\":{\"name\":\"rank %i\"}}",
+		 world_rank == 0 ? "" : ",\n", world_rank, world_rank);
+  for(uint64_t i = first; i < t->next; i++) {
+    const struct trace_event *e = &t->events[i % t->nr_events];
+    int64_t begin = (int64_t) (trace_ns(e->begin, global) - start);
+    uint64_t abs_begin = begin < 0 ? -(uint64_t) begin : (uint64_t) begin;
+    uint64_t dur = timer_elapsed(e->begin, e->end);
+    len += sprintf(buf + len, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+		   "\"ts\":%s%lu.%03lu,\"dur\":%lu.%03lu,\"pid\":0,\"tid\":%i,"
+		   "\"args\":{\"size\":%lu,\"iter\":%u,\"peer\":%i}}",
+		   trace_leg_names[e->leg], mode, begin < 0 ? "-" : "",
+		   (unsigned long) (abs_begin / 1000), (unsigned long) (abs_begin % 1000),
+		   (unsigned long) (dur / 1000), (unsigned long) (dur % 1000),
+		   world_rank, (unsigned long) e->size, e->iter, e->peer);
+  }
+  if(world_rank == world_size - 1)
+    len += sprintf(buf + len, "\n]}\n");
+
+  /* MPI_File_write_at_all() takes an int count */
+  MPI_Allreduce(&len, &max_len, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+  if(max_len > INT_MAX) {
+    if(world_rank == 0)
+      fprintf(stderr, "Trace of a rank exceeds %i bytes, reduce --trace-events\n", INT_MAX);
+    free(buf);
+    return -1;
+  }
+
+  MPI_Exscan(&len, &offset, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+  if(world_rank == 0)
+    offset = 0;
+  ret = MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+		      MPI_INFO_NULL, &fh);
+  if(ret == MPI_SUCCESS) {
+    MPI_File_set_size(fh, 0);
+    ret = MPI_File_write_at_all(fh, offset, buf, len, MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+  }
+  free(buf);
+  return ret;
+}
@@ -0,0 +1,57 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Per-rank event trace. Every leg of every kernel call is recorded as an
+ * event in a ring buffer allocated at startup, so only the last
+ * nr_events events are kept. trace_write() writes the events of all
+ * ranks in parallel with MPI-IO as Chrome trace JSON, which
+ * chrome://tracing and Perfetto show as one timeline per rank.
+ */
+#define TRACE_DEFAULT_EVENTS (1 << 18)
+
+struct trace_event {
+  /* timer_read() ticks */
+  uint64_t begin;
+  uint64_t end;
+  uint64_t size;
+  uint32_t iter;
+  int32_t peer;
+  uint32_t leg;
+};
+
+struct trace {
+  struct trace_event *events;
+  size_t nr_events;
+  /* events recorded so far, the next one goes to next % nr_events */
+  uint64_t next;
+};
+
+int trace_init(struct trace *t, size_t nr_events);
+void trace_free(struct trace *t);
+
+static inline void
+trace_add(struct trace *t, uint64_t begin, uint64_t end, uint64_t size,
+	  uint32_t iter, int32_t peer, uint32_t leg)
+{
+  struct trace_event *e = &t->events[t->next++ % t->nr_events];
+
+  e->begin = begin;
+  e->end = end;
+  e->size = size;
+  e->iter = iter;
+  e->peer = peer;
+  e->leg = leg;
+}
+
+/*
+ * collective, writes the events of all ranks to path, on the timeline of
+ * rank 0 with clock_global() if global is set
+ */
+int trace_write(struct trace *t, const char *path, const char *mode,
+    unsigned global);
+
+#endif